@@ -0,0 +1,215 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Cost of the descriptor analysis against descriptor size, item expansion
+ * and collection nesting, the three things bounded by UTOUCH_DESC_MAX,
+ * UTOUCH_PARSE_ITEMS_MAX and UTOUCH_PARSE_DEPTH_MAX.  For each generated
+ * descriptor it prints the time of a bare hid_get_item() walk, which is
+ * what probe would cost without the limits, and of utouch_hid_scan() and
+ * utouch_hid_parse() plus utouch_plan_compile() with them.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/endian.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/queue.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+
+#include <vm/vm.h>
+
+#include <err.h>
+#include <stdlib.h>
+
+#include <dev/hid/hid.h>
+
+#include "harness.h"
+#include "utouch.h"
+
+#define	BENCH_DESC_MAX	(1 << 16)
+
+static const uint8_t bench_head[] = {
+	0x05, 0x01,		/* Usage Page (Generic Desktop) */
+	0x09, 0x02,		/* Usage (Mouse) */
+	0xa1, 0x01,		/* Collection (Application) */
+};
+
+/* Absolute pointer body, three buttons and X and Y */
+static const uint8_t bench_pointer[] = {
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01,
+	0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05,
+	0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00,
+	0x26, 0xff, 0x7f, 0x75, 0x10, 0x95, 0x02, 0x81, 0x02,
+};
+
+/* 14 bytes expanding to 2048 items, the hid_get_item() cap per item */
+static const uint8_t bench_expand[] = {
+	0x05, 0x09,		/* Usage Page (Button) */
+	0x19, 0x01,		/* Usage Minimum (1) */
+	0x2a, 0xff, 0xff,	/* Usage Maximum (65535) */
+	0x75, 0x01,		/* Report Size (1) */
+	0x96, 0xff, 0xff,	/* Report Count (65535) */
+	0x81, 0x02,		/* Input (Var) */
+};
+
+static const uint8_t bench_nest[] = {
+	0x09, 0x01,		/* Usage (Pointer) */
+	0xa1, 0x00,		/* Collection (Physical) */
+};
+
+static uint8_t bench_desc[BENCH_DESC_MAX];
+static size_t bench_len;
+
+static void
+bench_add(const uint8_t *p, size_t len)
+{
+
+	if (bench_len + len > sizeof(bench_desc))
+		errx(1, "descriptor too large");
+	memcpy(bench_desc + bench_len, p, len);
+	bench_len += len;
+}
+
+static void
+bench_end(int n)
+{
+	static const uint8_t end = 0xc0;
+
+	while (n-- > 0)
+		bench_add(&end, 1);
+}
+
+/* Items and maximum depth a complete walk of the descriptor yields */
+static void
+bench_walk(int *items, int *depth)
+{
+	struct hid_data *hd;
+	struct hid_item hi;
+
+	*items = 0;
+	*depth = 0;
+	hd = hid_start_parse(bench_desc, bench_len, 1 << hid_input);
+	while (hid_get_item(hd, &hi)) {
+		(*items)++;
+		*depth = MAX(*depth, hi.collevel);
+	}
+	hid_end_parse(hd);
+}
+
+static void
+bench_walk_only(void)
+{
+	int items, depth;
+
+	bench_walk(&items, &depth);
+}
+
+static void
+bench_parse(void)
+{
+	static struct utouch_plan plan;
+
+	memset(&plan, 0, sizeof(plan));
+	utouch_hid_parse(&plan, bench_desc, bench_len);
+	utouch_plan_compile(&plan);
+}
+
+static void
+bench_run(const char *what, int n)
+{
+	double walk, scan, parse;
+	int items, depth, found;
+
+	bench_walk(&items, &depth);
+	found = utouch_hid_scan(bench_desc, bench_len, -1);
+	HARNESS_TIME(walk, bench_walk_only());
+	HARNESS_TIME(scan, utouch_hid_scan(bench_desc, bench_len, -1));
+	HARNESS_TIME(parse, bench_parse());
+	printf("%-10s %4d %6zu %6d %5d %9.2f %9.2f %9.2f  %s\n", what, n,
+	    bench_len, items, depth, walk, scan, parse,
+	    found != 0 ? "match" : "-");
+}
+
+int
+main(void)
+{
+	/* Up to the limit and past it */
+	static const int sizes[] = { 1, 4, 16, 64, 89, 128 };
+	static const int expansions[] = { 0, 1, 4, 16, 64, 256 };
+	static const int depths[] = { 1, 2, 4, 8, 9, 16, 64 };
+	u_int k;
+	int i, n;
+
+	printf("limits: %d bytes, %d items, depth %d\n\n", UTOUCH_DESC_MAX,
+	    UTOUCH_PARSE_ITEMS_MAX, UTOUCH_PARSE_DEPTH_MAX);
+	printf("%-10s %4s %6s %6s %5s %9s %9s %9s\n", "series", "n",
+	    "bytes", "items", "depth", "walk us", "scan us", "parse us");
+
+	/* Size: n absolute pointer collections one after the other */
+	for (k = 0; k < nitems(sizes); k++) {
+		n = sizes[k];
+		bench_len = 0;
+		for (i = 0; i < n; i++) {
+			bench_add(bench_head, sizeof(bench_head));
+			bench_add(bench_pointer, sizeof(bench_pointer));
+			bench_end(1);
+		}
+		bench_run("size", n);
+	}
+
+	/* Expansion: a pointer followed by n items of 2048 usages each */
+	for (k = 0; k < nitems(expansions); k++) {
+		n = expansions[k];
+		bench_len = 0;
+		bench_add(bench_head, sizeof(bench_head));
+		bench_add(bench_pointer, sizeof(bench_pointer));
+		for (i = 0; i < n; i++)
+			bench_add(bench_expand, sizeof(bench_expand));
+		bench_end(1);
+		bench_run("expansion", n);
+	}
+
+	/* Depth: the pointer inside n nested physical collections */
+	for (k = 0; k < nitems(depths); k++) {
+		n = depths[k];
+		bench_len = 0;
+		bench_add(bench_head, sizeof(bench_head));
+		for (i = 1; i < n; i++)
+			bench_add(bench_nest, sizeof(bench_nest));
+		bench_add(bench_pointer, sizeof(bench_pointer));
+		bench_end(n);
+		bench_run("depth", n);
+	}
+
+	return (0);
+}
@@ -0,0 +1,201 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Run the descriptors of corpus/, or the files given, through what probe
+ * and attach do with them and print, per descriptor, the probe decision
+ * of both attachments, the plan layout as dev.utouch.N.layout shows it
+ * after a USB attach and the time each step takes.
+ *
+ *	utouch_corpus file ...
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/endian.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/queue.h>
+#include <sys/sbuf.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/time.h>
+
+#include <vm/vm.h>
+
+#include <err.h>
+#include <stdlib.h>
+
+#include <dev/hid/hid.h>
+
+#include "harness.h"
+#include "utouch.h"
+
+#define	CORPUS_TLC_MAX	16
+
+static uint8_t corpus_desc[UTOUCH_DESC_MAX + 1];
+static size_t corpus_len;
+static struct utouch_plan *corpus_plan;
+
+/* hash32_buf(9) with HASHINIT, the plan cache key */
+static uint32_t
+corpus_hash(const uint8_t *p, size_t len)
+{
+	uint32_t hash = 5381;
+
+	while (len-- > 0)
+		hash = (hash << 5) + hash + *p++;
+	return (hash);
+}
+
+/* Top-level collections, items and maximum depth of a complete walk */
+static void
+corpus_walk(int *ntlc, int *items, int *depth)
+{
+	struct hid_data *hd;
+	struct hid_item hi;
+
+	*ntlc = 0;
+	*items = 0;
+	*depth = 0;
+	hd = hid_start_parse(corpus_desc, corpus_len, 1 << hid_input);
+	while (hid_get_item(hd, &hi)) {
+		(*items)++;
+		*depth = MAX(*depth, hi.collevel);
+		if (hi.kind == hid_collection && hi.collevel == 1)
+			(*ntlc)++;
+	}
+	hid_end_parse(hd);
+}
+
+static void
+corpus_parse(void)
+{
+
+	memset(corpus_plan, 0, sizeof(*corpus_plan));
+	corpus_plan->up_flags = UTOUCH_FLAG_FOLD_REL;
+	corpus_plan->up_dlen = corpus_len;
+	utouch_hid_parse(corpus_plan, corpus_desc, corpus_len);
+	utouch_plan_compile(corpus_plan);
+}
+
+/* What utouch_probe() in utouch.c returns for the scan result */
+static const char *
+corpus_usb_decision(int found)
+{
+
+	switch (found) {
+	case UTOUCH_TEST_MOUSE:
+	case UTOUCH_TEST_MOUSE | UTOUCH_TEST_TOUCH:
+		return ("BUS_PROBE_DEFAULT");
+	case UTOUCH_TEST_TOUCH:
+		return ("BUS_PROBE_GENERIC");
+	default:
+		return ("ENXIO");
+	}
+}
+
+static const char *
+corpus_kind(int found)
+{
+
+	switch (found) {
+	case UTOUCH_TEST_MOUSE:
+		return ("mouse");
+	case UTOUCH_TEST_TOUCH:
+		return ("touchscreen");
+	case UTOUCH_TEST_MOUSE | UTOUCH_TEST_TOUCH:
+		return ("mouse+touchscreen");
+	default:
+		return ("nothing");
+	}
+}
+
+static void
+corpus_run(const char *path)
+{
+	struct sbuf *sb;
+	sbintime_t t;
+	double us;
+	int ntlc, items, depth, found, matched, tlc;
+
+	corpus_len = harness_load(path, corpus_desc, sizeof(corpus_desc));
+	corpus_walk(&ntlc, &items, &depth);
+	printf("%s: %zu bytes, %d items, depth %d, %d top-level "
+	    "collections\n", path, corpus_len, items, depth, ntlc);
+
+	found = matched = utouch_hid_scan(corpus_desc, corpus_len, -1);
+	HARNESS_TIME(us, utouch_hid_scan(corpus_desc, corpus_len, -1));
+	printf("usb probe: %s, %s, %.2f us\n", corpus_kind(found),
+	    corpus_usb_decision(found), us);
+	for (tlc = 0; tlc < MIN(ntlc, CORPUS_TLC_MAX); tlc++) {
+		found = utouch_hid_scan(corpus_desc, corpus_len, tlc);
+		matched |= found;
+		HARNESS_TIME(us, utouch_hid_scan(corpus_desc, corpus_len,
+		    tlc));
+		printf("hidbus probe tlc %d: %s, %s, %.2f us\n", tlc,
+		    corpus_kind(found),
+		    found != 0 ? "BUS_PROBE_GENERIC" : "ENXIO", us);
+	}
+
+	if (matched == 0) {
+		printf("attach: not reached\n\n");
+		return;
+	}
+	HARNESS_TIME(us, corpus_parse());
+	t = sbinuptime();
+	corpus_parse();
+	corpus_plan->up_parse_time = sbinuptime() - t;
+	corpus_plan->up_hash = corpus_hash(corpus_desc, corpus_len);
+	printf("attach: %u collections, %.2f us", corpus_plan->up_ncolls, us);
+
+	sb = sbuf_new_auto();
+	utouch_plan_layout(corpus_plan, sb);
+	sbuf_finish(sb);
+	printf("%s\n\n", sbuf_data(sb));
+	sbuf_delete(sb);
+}
+
+int
+main(int argc, char **argv)
+{
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: utouch_corpus file ...\n");
+		return (1);
+	}
+	corpus_plan = malloc(sizeof(*corpus_plan) + sizeof(corpus_desc));
+	if (corpus_plan == NULL)
+		err(1, "malloc");
+	for (argc--, argv++; argc > 0; argc--, argv++)
+		corpus_run(*argv);
+	free(corpus_plan);
+	return (0);
+}
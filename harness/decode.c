@@ -0,0 +1,240 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Cost of a report through utouch_core_input(), as compiled for the
+ * kernel, with the kernel interfaces it calls stubbed out by kern.c.  For
+ * each descriptor it attaches a softc, opens its evdev devices and feeds
+ * it pseudo-random reports of every report ID the devices decode, so that
+ * most reports move the pointer and flip buttons.  It prints the time
+ * and, on x86, the TSC cycles per report, best of DECODE_ROUNDS passes
+ * over DECODE_REPORTS reports, and the events pushed per report.
+ *
+ * Built twice by the Makefile, as utouch_decode with the debug code in
+ * and turned off as it is by default, and as utouch_decode_nodebug with
+ * UTOUCH_NO_DEBUG.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/endian.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/queue.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/time.h>
+
+#include <vm/vm.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__amd64__) || defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define	DECODE_CYCLES
+#endif
+
+#include <dev/hid/hid.h>
+
+#include "harness.h"
+#include "utouch.h"
+
+#define	DECODE_REPORTS	4096
+#define	DECODE_ROUNDS	21
+
+static uint8_t decode_desc[UTOUCH_DESC_MAX];
+static uint8_t decode_reports[DECODE_REPORTS][UTOUCH_BUFSIZE];
+static int decode_len;
+
+static uint64_t
+decode_events(struct utouch_softc *sc)
+{
+	uint64_t n;
+	u_int i;
+
+	n = 0;
+	for (i = 0; i < UTOUCH_COLL_MAX; i++)
+		if (sc->sc_ev[i].ue_evdev != NULL)
+			n += harness_evdev_events(sc->sc_ev[i].ue_evdev);
+	return (n);
+}
+
+/* xorshift32, the same reports for both builds */
+static uint32_t
+decode_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return (*state = x);
+}
+
+/* Returns false if none of the report IDs has an evdev device */
+static bool
+decode_generate(struct utouch_softc *sc)
+{
+	struct utouch_plan *plan = sc->sc_plan;
+	uint8_t ids[256];
+	uint32_t state;
+	u_int id, nids, i, j;
+
+	nids = 0;
+	for (id = 0; id < nitems(plan->up_coll_by_id); id++)
+		if (plan->up_coll_by_id[id] != 0 &&
+		    sc->sc_ev[plan->up_coll_by_id[id] - 1].ue_evdev != NULL)
+			ids[nids++] = id;
+	if (nids == 0)
+		return (false);
+
+	decode_len = MAX(plan->up_rdlen,
+	    (plan->up_flags & UTOUCH_FLAG_HAS_ID) ? 2 : 1);
+	state = 0x2545f491;
+	for (i = 0; i < DECODE_REPORTS; i++) {
+		for (j = 0; j < (u_int)decode_len; j++)
+			decode_reports[i][j] = decode_random(&state);
+		if (plan->up_flags & UTOUCH_FLAG_HAS_ID)
+			decode_reports[i][0] = ids[decode_random(&state) % nids];
+	}
+	return (true);
+}
+
+/* The transport side of a report: copy it in and stamp it */
+static void
+decode_pass(struct utouch_softc *sc)
+{
+	u_int i;
+
+	mtx_lock(sc->sc_lock);
+	for (i = 0; i < DECODE_REPORTS; i++) {
+		memcpy(sc->sc_temp, decode_reports[i], decode_len);
+		utouch_core_input(sc, decode_len, sbinuptime());
+	}
+	mtx_unlock(sc->sc_lock);
+}
+
+static void
+decode_run(const char *path)
+{
+	static struct mtx mtx;
+	struct utouch_softc *sc;
+	const char *name;
+	double t, best_t;
+	uint64_t events;
+#ifdef DECODE_CYCLES
+	uint64_t c, best_c;
+#endif
+	size_t len;
+	u_int i, r;
+
+	name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+	len = harness_load(path, decode_desc, sizeof(decode_desc));
+	sc = aligned_alloc(CACHE_LINE_SIZE, roundup(sizeof(*sc),
+	    CACHE_LINE_SIZE));
+	if (sc == NULL)
+		err(1, "malloc");
+	memset(sc, 0, sizeof(*sc));
+	sc->sc_lock = &mtx;
+	if (utouch_core_init(sc) != 0)
+		errx(1, "%s: utouch_core_init failed", path);
+	if (utouch_core_attach(sc, decode_desc, len, -1) != 0) {
+		printf("%-28s no evdev device\n", name);
+		goto out;
+	}
+	mtx_lock(sc->sc_lock);
+	for (i = 0; i < UTOUCH_COLL_MAX; i++)
+		if (sc->sc_ev[i].ue_evdev != NULL &&
+		    harness_evdev_open(sc->sc_ev[i].ue_evdev) != 0)
+			errx(1, "%s: evdev open failed", path);
+	mtx_unlock(sc->sc_lock);
+	if (!decode_generate(sc)) {
+		printf("%-28s no report to decode\n", name);
+		goto out;
+	}
+
+	/* The first pass warms the caches up and counts the events */
+	events = decode_events(sc);
+	decode_pass(sc);
+	events = decode_events(sc) - events;
+
+	best_t = 0;
+#ifdef DECODE_CYCLES
+	best_c = 0;
+#endif
+	for (r = 0; r < DECODE_ROUNDS; r++) {
+		t = harness_now();
+#ifdef DECODE_CYCLES
+		c = __rdtsc();
+#endif
+		decode_pass(sc);
+#ifdef DECODE_CYCLES
+		c = __rdtsc() - c;
+		if (r == 0 || c < best_c)
+			best_c = c;
+#endif
+		t = harness_now() - t;
+		if (r == 0 || t < best_t)
+			best_t = t;
+	}
+
+	printf("%-28s %3d bytes %7.1f ns", name, decode_len,
+	    best_t * 1000 / DECODE_REPORTS);
+#ifdef DECODE_CYCLES
+	printf(" %6.0f cycles", (double)best_c / DECODE_REPORTS);
+#endif
+	printf(" %5.2f events\n", (double)events / DECODE_REPORTS);
+
+out:
+	utouch_core_detach(sc);
+	utouch_core_free(sc);
+	free(sc);
+}
+
+int
+main(int argc, char **argv)
+{
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: utouch_decode file ...\n");
+		return (1);
+	}
+#ifdef UTOUCH_NO_DEBUG
+	printf("UTOUCH_NO_DEBUG build, per report:\n");
+#else
+	printf("default build, verifier and lock profiling off, "
+	    "per report:\n");
+#endif
+	for (argc--, argv++; argc > 0; argc--, argv++)
+		decode_run(*argv);
+	return (0);
+}
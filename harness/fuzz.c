@@ -0,0 +1,249 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Fuzz target for the report descriptor analysis in utouch_hid.c.  Both
+ * the probe test and the plan builder are run on the input, and the plan
+ * is checked against what the decoder relies on: every compiled field
+ * stays inside the report buffer and extracts the same value as the
+ * reference hid_get_data() for the location it was compiled from.  The
+ * layout the dev.utouch.N.layout sysctl prints is built from it as well.
+ *
+ * Builds for libFuzzer as is, fuzz_main.c drives it without one.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/endian.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/queue.h>
+#include <sys/sbuf.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+
+#include <vm/vm.h>
+
+#include <stdlib.h>
+
+#include <dev/hid/hid.h>
+#include <dev/evdev/input.h>
+
+#include "utouch.h"
+
+#define	FUZZ_REPORTS	8	/* random reports decoded per plan */
+
+int	LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+static void
+fuzz_fail(const char *what, const struct utouch_plan *plan)
+{
+
+	fprintf(stderr, "utouch_fuzz: %s (%u collections, rdlen %u)\n", what,
+	    plan->up_ncolls, plan->up_rdlen);
+	abort();
+}
+
+/* xorshift32, seeded from the input so that runs reproduce */
+static uint32_t
+fuzz_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return (*state = x);
+}
+
+static void
+fuzz_check_field(const struct utouch_plan *plan, const uint8_t *buf, int len,
+    const struct utouch_field *uf, const struct hid_location *loc)
+{
+	int32_t fast, ref;
+
+	if (uf->uf_off + sizeof(uint32_t) > UTOUCH_BUFSIZE)
+		fuzz_fail("field past the report buffer", plan);
+
+	fast = utouch_field_value(buf, uf);
+	if (uf->uf_flags & UTOUCH_FIELD_UNSIGNED)
+		ref = hid_get_udata(buf, len, __DECONST(struct hid_location *,
+		    loc));
+	else
+		ref = hid_get_data(buf, len, __DECONST(struct hid_location *,
+		    loc));
+	if (fast != ref) {
+		fprintf(stderr, "utouch_fuzz: pos %u size %u len %d: "
+		    "got %d, expected %d\n", loc->pos, loc->size, len, fast,
+		    ref);
+		fuzz_fail("decoder mismatch", plan);
+	}
+}
+
+/*
+ * Decode a report of every report ID the plan routes the way
+ * utouch_decode() does: zero the bytes past a short report up to
+ * up_rdlen, strip the report ID and extract every field of it.  The rest
+ * of the buffer holds junk, as sc_temp would from an earlier report.
+ */
+static void
+fuzz_decode(const struct utouch_plan *plan, uint32_t *seed)
+{
+	const struct utouch_coll *uc;
+	uint8_t *temp, *buf;
+	u_int i, j, u, r;
+	int id, len;
+
+	temp = malloc(UTOUCH_BUFSIZE);
+	if (temp == NULL)
+		abort();
+	for (r = 0; r < FUZZ_REPORTS; r++) {
+		for (id = 0; id < 256; id++) {
+			if (plan->up_coll_by_id[id] == 0)
+				continue;
+			uc = &plan->up_colls[plan->up_coll_by_id[id] - 1];
+
+			memset(temp, 0xa5, UTOUCH_BUFSIZE);
+			len = fuzz_random(seed) % (UTOUCH_REPORT_MAX + 1);
+			for (i = 0; i < (u_int)len; i++)
+				temp[i] = fuzz_random(seed);
+			if (len < plan->up_rdlen)
+				memset(temp + len, 0, plan->up_rdlen - len);
+			buf = temp;
+			if (plan->up_flags & UTOUCH_FLAG_HAS_ID) {
+				if (len == 0)
+					continue;
+				temp[0] = id;
+				buf++;
+				len--;
+			}
+
+			for (i = 0; i < uc->uc_nfields; i++)
+				if (uc->uc_fields[i].uf_id == id)
+					fuzz_check_field(plan, buf, len,
+					    &uc->uc_fields[i],
+					    &uc->uc_field_loc[i]);
+			if ((uc->uc_flags & UTOUCH_FLAG_MT) == 0 ||
+			    id != uc->uc_iid_mt)
+				continue;
+			if (uc->uc_flags & UTOUCH_FLAG_MT_COUNT)
+				fuzz_check_field(plan, buf, len,
+				    &uc->uc_mt_count, &uc->uc_mt_loc_count);
+			for (j = 0; j < uc->uc_mt_ncontacts; j++)
+				for (u = 0; u < UTOUCH_MT_NUSAGES; u++)
+					if (uc->uc_mt_usages[j] & (1 << u))
+						fuzz_check_field(plan, buf,
+						    len, &uc->uc_mt_fields[j][u],
+						    &uc->uc_mt_loc[j][u]);
+		}
+	}
+	free(temp);
+}
+
+static void
+fuzz_check_plan(const struct utouch_plan *plan)
+{
+	const struct utouch_coll *uc;
+	u_int i;
+
+	if (plan->up_ncolls > UTOUCH_COLL_MAX)
+		fuzz_fail("too many collections", plan);
+	if (plan->up_rdlen > UTOUCH_BUFSIZE)
+		fuzz_fail("rdlen past the report buffer", plan);
+	for (i = 0; i < nitems(plan->up_coll_by_id); i++)
+		if (plan->up_coll_by_id[i] > plan->up_ncolls)
+			fuzz_fail("report ID routed to no collection", plan);
+	for (i = 0; i < plan->up_ncolls; i++) {
+		uc = &plan->up_colls[i];
+		if (uc->uc_nfields > UTOUCH_FIELD_MAX)
+			fuzz_fail("too many fields", plan);
+		if (uc->uc_nbuttons > UTOUCH_BUTTON_MAX)
+			fuzz_fail("too many buttons", plan);
+		if (uc->uc_flags & UTOUCH_FLAG_MT &&
+		    (uc->uc_mt_ncontacts == 0 ||
+		    uc->uc_mt_ncontacts > UTOUCH_MT_MAX ||
+		    uc->uc_mt_nslots < uc->uc_mt_ncontacts ||
+		    uc->uc_mt_nslots > UTOUCH_MT_MAX))
+			fuzz_fail("bad contact count", plan);
+		if ((uc->uc_flags & (UTOUCH_FLAG_X_AXIS | UTOUCH_FLAG_Y_AXIS |
+		    UTOUCH_FLAG_MT)) == 0)
+			fuzz_fail("collection with nothing absolute", plan);
+	}
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	static const uint32_t flags[] = { 0, UTOUCH_FLAG_FOLD_REL };
+	struct utouch_plan *plan;
+	struct sbuf *sb;
+	uint32_t seed;
+	size_t i;
+	u_int f;
+	int tlc;
+
+	for (tlc = -1; tlc < 4; tlc++)
+		if (utouch_hid_scan(data, size, tlc) &
+		    ~(UTOUCH_TEST_MOUSE | UTOUCH_TEST_TOUCH))
+			abort();
+
+	/* Attach only gets descriptors which passed the probe size check */
+	if (size > UTOUCH_DESC_MAX)
+		return (0);
+
+	plan = malloc(sizeof(*plan) + size);
+	if (plan == NULL)
+		abort();
+	seed = 2166136261U;
+	for (i = 0; i < size; i++)
+		seed = (seed ^ data[i]) * 16777619U;
+	seed |= 1;
+
+	/* Plans of both attachments, for hidbus(4) and for the whole device */
+	for (f = 0; f < nitems(flags); f++) {
+		memset(plan, 0, sizeof(*plan));
+		plan->up_flags = flags[f];
+		plan->up_dlen = size;
+		memcpy(plan->up_desc, data, size);
+		utouch_hid_parse(plan, data, size);
+		utouch_plan_compile(plan);
+		fuzz_check_plan(plan);
+
+		sb = sbuf_new_auto();
+		utouch_plan_layout(plan, sb);
+		sbuf_finish(sb);
+		sbuf_delete(sb);
+
+		fuzz_decode(plan, &seed);
+	}
+
+	free(plan);
+	return (0);
+}
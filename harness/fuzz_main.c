@@ -0,0 +1,255 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Minimal driver for the fuzz target where libFuzzer is not available:
+ * runs the target on the files given and then on random mutations of
+ * them and of a few built-in descriptors.  Files are read as
+ * harness_load() does, so the corpus/ files can be given as seeds.
+ *
+ *	utouch_fuzz [-n iterations] [-s seed] [file ...]
+ */
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "harness.h"
+
+#define	FUZZ_SIZE_MAX	8192	/* twice UTOUCH_DESC_MAX */
+#define	FUZZ_SEEDS_MAX	64
+
+int	LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+/* Absolute tablet mouse, as emulated by QEMU usb-tablet */
+static const uint8_t fuzz_tablet[] = {
+	0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x09, 0x01, 0xa1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01,
+	0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05,
+	0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00,
+	0x26, 0xff, 0x7f, 0x35, 0x00, 0x46, 0xff, 0x7f, 0x75, 0x10,
+	0x95, 0x02, 0x81, 0x02, 0x05, 0x01, 0x09, 0x38, 0x15, 0x81,
+	0x25, 0x7f, 0x35, 0x00, 0x45, 0x00, 0x75, 0x08, 0x95, 0x01,
+	0x81, 0x06, 0xc0, 0xc0,
+};
+
+/* Two contact touchscreen with report ID and contact count */
+static const uint8_t fuzz_touch[] = {
+	0x05, 0x0d, 0x09, 0x04, 0xa1, 0x01, 0x85, 0x01,
+	0x09, 0x22, 0xa1, 0x02,
+	0x09, 0x42, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01,
+	0x81, 0x02, 0x95, 0x07, 0x81, 0x03,
+	0x09, 0x51, 0x25, 0x0f, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+	0x05, 0x01, 0x26, 0xff, 0x0f, 0x75, 0x10, 0x55, 0x0e, 0x65,
+	0x11, 0x35, 0x00, 0x46, 0xb5, 0x04, 0x09, 0x30, 0x81, 0x02,
+	0x46, 0x8a, 0x03, 0x09, 0x31, 0x81, 0x02, 0xc0,
+	0x05, 0x0d, 0x09, 0x22, 0xa1, 0x02,
+	0x09, 0x42, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01,
+	0x81, 0x02, 0x95, 0x07, 0x81, 0x03,
+	0x09, 0x51, 0x25, 0x0f, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+	0x05, 0x01, 0x26, 0xff, 0x0f, 0x75, 0x10, 0x55, 0x0e, 0x65,
+	0x11, 0x35, 0x00, 0x46, 0xb5, 0x04, 0x09, 0x30, 0x81, 0x02,
+	0x46, 0x8a, 0x03, 0x09, 0x31, 0x81, 0x02, 0xc0,
+	0x05, 0x0d, 0x09, 0x54, 0x25, 0x0a, 0x75, 0x08, 0x95, 0x01,
+	0x81, 0x02, 0xc0,
+};
+
+/* Plain relative mouse with a wheel */
+static const uint8_t fuzz_mouse[] = {
+	0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x09, 0x01, 0xa1, 0x00,
+	0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01,
+	0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05,
+	0x81, 0x03, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38,
+	0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+	0xc0, 0xc0,
+};
+
+struct fuzz_seed {
+	uint8_t	*fs_data;
+	size_t	fs_size;
+};
+
+static struct fuzz_seed fuzz_seeds[FUZZ_SEEDS_MAX];
+static u_int fuzz_nseeds;
+
+static void
+fuzz_add_seed(const uint8_t *data, size_t size)
+{
+	struct fuzz_seed *fs;
+
+	if (fuzz_nseeds == FUZZ_SEEDS_MAX)
+		return;
+	fs = &fuzz_seeds[fuzz_nseeds++];
+	fs->fs_data = malloc(size);
+	if (fs->fs_data == NULL)
+		err(1, "malloc");
+	memcpy(fs->fs_data, data, size);
+	fs->fs_size = size;
+}
+
+/* Random short item: prefix byte and 0, 1, 2 or 4 data bytes */
+static size_t
+fuzz_item(uint8_t *p)
+{
+	static const uint8_t sizes[4] = { 0, 1, 2, 4 };
+	size_t i, n;
+
+	p[0] = random();
+	n = sizes[p[0] & 3];
+	for (i = 1; i <= n; i++)
+		p[i] = random() & 1 ? random() : (random() & 1 ? 0xff : 0);
+	return (n + 1);
+}
+
+static size_t
+fuzz_mutate(uint8_t *buf, size_t size)
+{
+	const struct fuzz_seed *fs;
+	size_t off, n;
+	uint8_t item[5];
+	int k;
+
+	for (k = 1 + random() % 4; k > 0; k--) {
+		off = size != 0 ? random() % size : 0;
+		switch (random() % 7) {
+		case 0:		/* bit flip */
+			if (size != 0)
+				buf[off] ^= 1 << (random() % 8);
+			break;
+		case 1:		/* random byte */
+			if (size != 0)
+				buf[off] = random();
+			break;
+		case 2:		/* insert an item */
+			n = fuzz_item(item);
+			if (size + n > FUZZ_SIZE_MAX)
+				break;
+			memmove(buf + off + n, buf + off, size - off);
+			memcpy(buf + off, item, n);
+			size += n;
+			break;
+		case 3:		/* delete a range */
+			n = 1 + random() % 8;
+			n = MIN(size - off, n);
+			memmove(buf + off, buf + off + n, size - off - n);
+			size -= n;
+			break;
+		case 4:		/* duplicate a range */
+			n = 1 + random() % 64;
+			n = MIN(size - off, n);
+			if (size + n > FUZZ_SIZE_MAX)
+				break;
+			memmove(buf + off + n, buf + off, size - off);
+			size += n;
+			break;
+		case 5:		/* splice in a part of another seed */
+			fs = &fuzz_seeds[random() % fuzz_nseeds];
+			if (fs->fs_size == 0)
+				break;
+			n = random() % fs->fs_size;
+			n = MIN(fs->fs_size - n, FUZZ_SIZE_MAX - off);
+			memcpy(buf + off, fs->fs_data + fs->fs_size - n, n);
+			size = MAX(size, off + n);
+			break;
+		case 6:		/* interesting value in a data byte */
+			if (size != 0)
+				buf[off] = random() & 1 ? 0x80 : 0x7f;
+			break;
+		}
+	}
+	return (size);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: utouch_fuzz [-n iterations] [-s seed] "
+	    "[file ...]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct fuzz_seed *fs;
+	uint8_t *buf;
+	struct timespec t0, t1;
+	unsigned long i, n;
+	size_t size;
+	int ch;
+
+	n = 100000;
+	srandom(time(NULL));
+	while ((ch = getopt(argc, argv, "n:s:")) != -1) {
+		switch (ch) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			srandom(strtoul(optarg, NULL, 0));
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	buf = malloc(FUZZ_SIZE_MAX);
+	if (buf == NULL)
+		err(1, "malloc");
+
+	for (; argc > 0; argc--, argv++) {
+		size = harness_load(*argv, buf, FUZZ_SIZE_MAX);
+		LLVMFuzzerTestOneInput(buf, size);
+		fuzz_add_seed(buf, size);
+	}
+	fuzz_add_seed(fuzz_tablet, sizeof(fuzz_tablet));
+	fuzz_add_seed(fuzz_touch, sizeof(fuzz_touch));
+	fuzz_add_seed(fuzz_mouse, sizeof(fuzz_mouse));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++) {
+		fs = &fuzz_seeds[i % fuzz_nseeds];
+		memcpy(buf, fs->fs_data, fs->fs_size);
+		size = fuzz_mutate(buf, fs->fs_size);
+		LLVMFuzzerTestOneInput(buf, size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%lu inputs in %.1f s, no failures\n", n,
+	    (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	free(buf);
+	return (0);
+}
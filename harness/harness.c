@@ -0,0 +1,102 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Helpers shared by the harness programs.
+ */
+
+#include <sys/param.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "harness.h"
+
+double
+harness_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+/*
+ * Read a report descriptor.  Files named *.hex, as in corpus/, hold it as
+ * hex bytes with comments from '#' to the end of the line, anything else
+ * is taken as the raw descriptor.  Exits on errors, returns the length.
+ */
+size_t
+harness_load(const char *path, uint8_t *buf, size_t size)
+{
+	FILE *f;
+	size_t len, plen;
+	int ch, nibble, byte;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		err(1, "%s", path);
+	plen = strlen(path);
+	if (plen < 4 || strcmp(path + plen - 4, ".hex") != 0) {
+		len = fread(buf, 1, size, f);
+		if (ferror(f))
+			err(1, "%s", path);
+		fclose(f);
+		return (len);
+	}
+
+	len = 0;
+	nibble = 0;
+	byte = 0;
+	while ((ch = getc(f)) != EOF) {
+		if (ch == '#') {
+			while ((ch = getc(f)) != EOF && ch != '\n')
+				;
+			continue;
+		}
+		if (isspace(ch) || ch == ',')
+			continue;
+		if (!isxdigit(ch))
+			errx(1, "%s: bad character '%c'", path, ch);
+		byte = byte << 4 | (isdigit(ch) ? ch - '0' :
+		    tolower(ch) - 'a' + 10);
+		if (++nibble < 2)
+			continue;
+		if (len == size)
+			errx(1, "%s: longer than %zu bytes", path, size);
+		buf[len++] = byte;
+		nibble = 0;
+		byte = 0;
+	}
+	if (nibble != 0)
+		errx(1, "%s: odd number of hex digits", path);
+	fclose(f);
+	return (len);
+}
@@ -0,0 +1,40 @@
+/*
+ * Helpers shared by the harness programs: descriptor files and timing.
+ */
+#ifndef _HARNESS_H_
+#define	_HARNESS_H_
+
+/* Best of a few rounds, us per evaluation of expr */
+#define	HARNESS_TIME(res, expr) do {					\
+	double _t, _best;						\
+	int _r, _i, _n;							\
+									\
+	_n = 1;								\
+	do {								\
+		_t = harness_now();					\
+		for (_i = 0; _i < _n; _i++)				\
+			expr;						\
+		_t = harness_now() - _t;				\
+		_n *= 2;						\
+	} while (_t < 2000);						\
+	_n /= 2;							\
+	_best = _t;							\
+	for (_r = 0; _r < 5; _r++) {					\
+		_t = harness_now();					\
+		for (_i = 0; _i < _n; _i++)				\
+			expr;						\
+		_best = MIN(_best, harness_now() - _t);			\
+	}								\
+	(res) = _best / _n;						\
+} while (0)
+
+struct evdev_dev;
+
+double	harness_now(void);
+size_t	harness_load(const char *, uint8_t *, size_t);
+
+/* kern.c */
+int	harness_evdev_open(struct evdev_dev *);
+uint64_t harness_evdev_events(struct evdev_dev *);
+
+#endif /* !_HARNESS_H_ */
@@ -0,0 +1,555 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Stand-in for the kernel HID item parser, sys/dev/hid/hid.c, with the
+ * same item expansion, usage ranges, push/pop, per report ID positions and
+ * limits, so that descriptors are walked the way probe and attach see them.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+
+#include <stdlib.h>
+
+#include <dev/hid/hid.h>
+
+#define	MAXUSAGE	64
+#define	MAXPUSH		4
+#define	MAXID		16
+#define	MAXLOCCNT	2048
+
+struct hid_pos_data {
+	int32_t rid;
+	uint32_t pos;
+};
+
+struct hid_data {
+	const uint8_t *start;
+	const uint8_t *end;
+	const uint8_t *p;
+	struct hid_item cur[MAXPUSH];
+	struct hid_pos_data last_pos[MAXID];
+	int32_t	usages_min[MAXUSAGE];
+	int32_t	usages_max[MAXUSAGE];
+	int32_t	usage_last;	/* last seen usage */
+	uint32_t loc_size;	/* last seen size */
+	uint32_t loc_count;	/* last seen count */
+	uint32_t ncount;	/* end usage item count */
+	uint32_t icount;	/* current usage item count */
+	uint8_t	kindset;
+	uint8_t	pushlevel;
+	uint8_t	nusage;		/* end "usages_min/max" index */
+	uint8_t	iusage;		/* current "usages_min/max" index */
+	uint32_t ousage;	/* current "usages_min/max" offset */
+	uint8_t	susage;		/* usage set flags */
+};
+
+static void
+hid_clear_local(struct hid_item *c)
+{
+
+	c->loc.count = 0;
+	c->loc.size = 0;
+	c->nusages = 0;
+	c->usage = 0;
+	c->usage_minimum = 0;
+	c->usage_maximum = 0;
+	c->designator_index = 0;
+	c->designator_minimum = 0;
+	c->designator_maximum = 0;
+	c->string_index = 0;
+	c->string_minimum = 0;
+	c->string_maximum = 0;
+	c->set_delimiter = 0;
+}
+
+static void
+hid_switch_rid(struct hid_data *s, struct hid_item *c, int32_t next_rID)
+{
+	uint8_t i;
+
+	if (c->report_ID == next_rID)
+		return;
+
+	/* Save the position of the current report ID */
+	if (c->report_ID == 0)
+		i = 0;
+	else {
+		for (i = 1; i != MAXID; i++) {
+			if (s->last_pos[i].rid == c->report_ID)
+				break;
+			if (s->last_pos[i].rid == 0)
+				break;
+		}
+	}
+	if (i != MAXID) {
+		s->last_pos[i].rid = c->report_ID;
+		s->last_pos[i].pos = c->loc.pos;
+	}
+
+	c->report_ID = next_rID;
+
+	/* And continue from the last position of the next one */
+	if (next_rID == 0)
+		i = 0;
+	else {
+		for (i = 1; i != MAXID; i++) {
+			if (s->last_pos[i].rid == next_rID)
+				break;
+			if (s->last_pos[i].rid == 0)
+				break;
+		}
+	}
+	if (i != MAXID) {
+		s->last_pos[i].rid = next_rID;
+		c->loc.pos = s->last_pos[i].pos;
+	} else
+		c->loc.pos = 0;
+}
+
+struct hid_data *
+hid_start_parse(const void *d, hid_size_t len, int kindset)
+{
+	struct hid_data *s;
+
+	if ((kindset - 1) & kindset)
+		return (NULL);
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		abort();
+	s->start = s->p = d;
+	s->end = (const uint8_t *)d + len;
+	s->kindset = kindset;
+	return (s);
+}
+
+void
+hid_end_parse(struct hid_data *s)
+{
+
+	free(s);
+}
+
+static uint8_t
+hid_get_byte(struct hid_data *s, const uint16_t wSize)
+{
+	const uint8_t *ptr;
+	uint8_t retval;
+
+	ptr = s->p;
+	if (ptr == s->end)
+		return (0);
+
+	retval = *ptr;
+	if ((s->end - ptr) < wSize)
+		ptr = s->end;
+	else
+		ptr += wSize;
+	s->p = ptr;
+
+	return (retval);
+}
+
+int
+hid_get_item(struct hid_data *s, struct hid_item *h)
+{
+	struct hid_item *c;
+	unsigned int bTag, bType, bSize;
+	uint32_t oldpos;
+	int32_t mask;
+	int32_t dval;
+
+	if (s == NULL)
+		return (0);
+
+	c = &s->cur[s->pushlevel];
+
+ top:
+	/* Array of items: one per report count */
+	if (s->icount < s->ncount) {
+		if (s->iusage < s->nusage) {
+			dval = s->usages_min[s->iusage] + s->ousage;
+			c->usage = dval;
+			s->usage_last = dval;
+			if (dval == s->usages_max[s->iusage]) {
+				s->iusage++;
+				s->ousage = 0;
+			} else
+				s->ousage++;
+		} else
+			dval = s->usage_last;
+		c->nusages = 1;
+		s->icount++;
+		if (s->kindset & (1 << c->kind)) {
+			*h = *c;
+			c->loc.pos += c->loc.size * c->loc.count;
+			return (1);
+		}
+	}
+
+	s->icount = 0;
+	s->ncount = 0;
+	s->iusage = 0;
+	s->nusage = 0;
+	s->susage = 0;
+	s->ousage = 0;
+	hid_clear_local(c);
+
+	while (s->p != s->end) {
+		bSize = hid_get_byte(s, 1);
+		if (bSize == 0xfe) {
+			/* Long item */
+			bSize = hid_get_byte(s, 1);
+			bSize |= hid_get_byte(s, 1) << 8;
+			bTag = hid_get_byte(s, 1);
+			bType = 0xff;
+		} else {
+			/* Short item */
+			bTag = bSize >> 4;
+			bType = (bSize >> 2) & 3;
+			bSize &= 3;
+			if (bSize == 3)
+				bSize = 4;
+		}
+		switch (bSize) {
+		case 0:
+			dval = 0;
+			mask = 0;
+			break;
+		case 1:
+			dval = (int8_t)hid_get_byte(s, 1);
+			mask = 0xFF;
+			break;
+		case 2:
+			dval = hid_get_byte(s, 1);
+			dval |= hid_get_byte(s, 1) << 8;
+			dval = (int16_t)dval;
+			mask = 0xFFFF;
+			break;
+		case 4:
+			dval = hid_get_byte(s, 1);
+			dval |= hid_get_byte(s, 1) << 8;
+			dval |= hid_get_byte(s, 1) << 16;
+			dval |= (uint32_t)hid_get_byte(s, 1) << 24;
+			mask = 0xFFFFFFFF;
+			break;
+		default:
+			dval = hid_get_byte(s, bSize);
+			continue;
+		}
+
+		switch (bType) {
+		case 0:		/* Main */
+			switch (bTag) {
+			case 8:	/* Input */
+				c->kind = hid_input;
+		ret:
+				c->flags = dval;
+				c->loc.count = s->loc_count;
+				c->loc.size = s->loc_size;
+
+				if (c->flags & HIO_VARIABLE) {
+					if (c->loc.count > MAXLOCCNT)
+						s->ncount = MAXLOCCNT;
+					else
+						s->ncount = c->loc.count;
+					c->loc.count = 1;
+				} else
+					s->ncount = 1;
+				goto top;
+			case 9:	/* Output */
+				c->kind = hid_output;
+				goto ret;
+			case 10:	/* Collection */
+				c->kind = hid_collection;
+				c->collection = dval;
+				c->collevel++;
+				c->usage = s->usage_last;
+				c->nusages = 1;
+				*h = *c;
+				return (1);
+			case 11:	/* Feature */
+				c->kind = hid_feature;
+				goto ret;
+			case 12:	/* End collection */
+				c->kind = hid_endcollection;
+				if (c->collevel == 0)
+					return (0);
+				c->collevel--;
+				*h = *c;
+				return (1);
+			default:
+				break;
+			}
+			break;
+		case 1:		/* Global */
+			switch (bTag) {
+			case 0:
+				c->_usage_page = (uint32_t)dval << 16;
+				break;
+			case 1:
+				c->logical_minimum = dval;
+				break;
+			case 2:
+				c->logical_maximum = dval;
+				break;
+			case 3:
+				c->physical_minimum = dval;
+				break;
+			case 4:
+				c->physical_maximum = dval;
+				break;
+			case 5:
+				c->unit_exponent = dval;
+				break;
+			case 6:
+				c->unit = dval;
+				break;
+			case 7:
+				s->loc_size = dval & mask;
+				break;
+			case 8:
+				hid_switch_rid(s, c, dval & mask);
+				break;
+			case 9:
+				s->loc_count = dval & mask;
+				break;
+			case 10:	/* Push */
+				if ((s->pushlevel + 1) >= MAXPUSH)
+					return (0);
+				s->pushlevel++;
+				s->cur[s->pushlevel] = *c;
+				c->loc.size = s->loc_size;
+				c->loc.count = s->loc_count;
+				c = &s->cur[s->pushlevel];
+				break;
+			case 11:	/* Pop */
+				if (s->pushlevel == 0)
+					return (0);
+				s->pushlevel--;
+				oldpos = c->loc.pos;
+				c = &s->cur[s->pushlevel];
+				s->loc_size = c->loc.size;
+				s->loc_count = c->loc.count;
+				c->loc.pos = oldpos;
+				c->loc.size = 0;
+				c->loc.count = 0;
+				break;
+			default:
+				break;
+			}
+			break;
+		case 2:		/* Local */
+			switch (bTag) {
+			case 0:
+				if (bSize != 4)
+					dval = (dval & mask) | c->_usage_page;
+				s->usage_last = dval;
+				if (s->nusage < MAXUSAGE) {
+					s->usages_min[s->nusage] = dval;
+					s->usages_max[s->nusage] = dval;
+					s->nusage++;
+				}
+				s->susage = 0;
+				break;
+			case 1:
+				s->susage |= 1;
+				if (bSize != 4)
+					dval = (dval & mask) | c->_usage_page;
+				c->usage_minimum = dval;
+				goto check_set;
+			case 2:
+				s->susage |= 2;
+				if (bSize != 4)
+					dval = (dval & mask) | c->_usage_page;
+				c->usage_maximum = dval;
+			check_set:
+				if (s->susage != 3)
+					break;
+				if (s->nusage < MAXUSAGE &&
+				    c->usage_minimum <= c->usage_maximum) {
+					s->usages_min[s->nusage] =
+					    c->usage_minimum;
+					s->usages_max[s->nusage] =
+					    c->usage_maximum;
+					s->nusage++;
+				}
+				s->susage = 0;
+				break;
+			case 3:
+				c->designator_index = dval;
+				break;
+			case 4:
+				c->designator_minimum = dval;
+				break;
+			case 5:
+				c->designator_maximum = dval;
+				break;
+			case 7:
+				c->string_index = dval;
+				break;
+			case 8:
+				c->string_minimum = dval;
+				break;
+			case 9:
+				c->string_maximum = dval;
+				break;
+			case 10:
+				c->set_delimiter = dval;
+				break;
+			default:
+				break;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return (0);
+}
+
+static uint32_t
+hid_get_data_sub(const uint8_t *buf, hid_size_t len, struct hid_location *loc,
+    int is_signed)
+{
+	uint32_t hpos = loc->pos;
+	uint32_t hsize = loc->size;
+	uint32_t data;
+	uint32_t rpos;
+	uint8_t n;
+
+	if (hsize == 0)
+		return (0);
+	if (hsize > 32)
+		hsize = 32;
+
+	/* Bytes past the end of the report read as zero */
+	data = 0;
+	rpos = hpos / 8;
+	n = (hsize + 7) / 8;
+	rpos += n;
+	while (n--) {
+		rpos--;
+		if (rpos < len)
+			data |= (uint32_t)buf[rpos] << (8 * n);
+	}
+
+	data = data >> (hpos % 8);
+	n = 32 - hsize;
+
+	/* Mask and sign extend in one */
+	if (is_signed != 0)
+		data = (int32_t)(data << n) >> n;
+	else
+		data = (data << n) >> n;
+
+	return (data);
+}
+
+int32_t
+hid_get_data(const uint8_t *buf, hid_size_t len, struct hid_location *loc)
+{
+
+	return (hid_get_data_sub(buf, len, loc, 1));
+}
+
+uint32_t
+hid_get_udata(const uint8_t *buf, hid_size_t len, struct hid_location *loc)
+{
+
+	return (hid_get_data_sub(buf, len, loc, 0));
+}
+
+int32_t
+hid_item_resolution(struct hid_item *hi)
+{
+	/* Unit exponent scale, HUTRR39 table 17 */
+	static const int64_t scale[0x10][2] = {
+	    [0x00] = { 1, 1 },
+	    [0x01] = { 1, 10 },
+	    [0x02] = { 1, 100 },
+	    [0x03] = { 1, 1000 },
+	    [0x04] = { 1, 10000 },
+	    [0x05] = { 1, 100000 },
+	    [0x06] = { 1, 1000000 },
+	    [0x07] = { 1, 10000000 },
+	    [0x08] = { 100000000, 1 },
+	    [0x09] = { 10000000, 1 },
+	    [0x0A] = { 1000000, 1 },
+	    [0x0B] = { 100000, 1 },
+	    [0x0C] = { 10000, 1 },
+	    [0x0D] = { 1000, 1 },
+	    [0x0E] = { 100, 1 },
+	    [0x0F] = { 10, 1 },
+	};
+	int64_t logical_size;
+	int64_t physical_size;
+	int64_t multiplier;
+	int64_t divisor;
+	int64_t resolution;
+
+	switch (hi->unit) {
+	case HUM_CENTIMETER:
+		multiplier = 1;
+		divisor = 10;
+		break;
+	case HUM_INCH:
+		multiplier = 10;
+		divisor = 254;
+		break;
+	case HUM_RADIAN:
+		multiplier = 1;
+		divisor = 1;
+		break;
+	case HUM_DEGREE:
+		multiplier = 573;
+		divisor = 10;
+		break;
+	default:
+		return (0);
+	}
+
+	if ((hi->logical_maximum <= hi->logical_minimum) ||
+	    (hi->physical_maximum <= hi->physical_minimum) ||
+	    (hi->unit_exponent < 0) || (hi->unit_exponent >= (int)nitems(scale)))
+		return (0);
+
+	logical_size = (int64_t)hi->logical_maximum -
+	    (int64_t)hi->logical_minimum;
+	physical_size = (int64_t)hi->physical_maximum -
+	    (int64_t)hi->physical_minimum;
+	resolution = logical_size * multiplier * scale[hi->unit_exponent][0] /
+	    (physical_size * divisor * scale[hi->unit_exponent][1]);
+
+	if (resolution > INT32_MAX)
+		return (0);
+
+	return (resolution);
+}
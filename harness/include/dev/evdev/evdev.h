@@ -0,0 +1,61 @@
+/*
+ * Userspace stand-in for <dev/evdev/evdev.h>.  Devices only count the
+ * events pushed to them, see ../kern.c.
+ */
+#ifndef _HARNESS_EVDEV_EVDEV_H_
+#define	_HARNESS_EVDEV_EVDEV_H_
+
+#include <stdint.h>
+
+struct evdev_dev;
+struct mtx;
+
+struct input_absinfo {
+	int32_t	value;
+	int32_t	minimum;
+	int32_t	maximum;
+	int32_t	fuzz;
+	int32_t	flat;
+	int32_t	resolution;
+};
+
+typedef int (evdev_open_t)(struct evdev_dev *);
+typedef int (evdev_close_t)(struct evdev_dev *);
+
+struct evdev_methods {
+	evdev_open_t *ev_open;
+	evdev_close_t *ev_close;
+};
+
+struct evdev_dev *evdev_alloc(void);
+void	evdev_free(struct evdev_dev *);
+void	evdev_set_name(struct evdev_dev *, const char *);
+void	evdev_set_phys(struct evdev_dev *, const char *);
+void	evdev_set_id(struct evdev_dev *, uint16_t, uint16_t, uint16_t,
+	    uint16_t);
+void	evdev_set_serial(struct evdev_dev *, const char *);
+void	evdev_set_methods(struct evdev_dev *, void *,
+	    const struct evdev_methods *);
+void	*evdev_get_softc(struct evdev_dev *);
+int	evdev_register_mtx(struct evdev_dev *, struct mtx *);
+void	evdev_support_prop(struct evdev_dev *, uint16_t);
+void	evdev_support_event(struct evdev_dev *, uint16_t);
+void	evdev_support_key(struct evdev_dev *, uint16_t);
+void	evdev_support_rel(struct evdev_dev *, uint16_t);
+void	evdev_support_abs(struct evdev_dev *, uint16_t, int32_t, int32_t,
+	    int32_t, int32_t, int32_t);
+void	evdev_support_msc(struct evdev_dev *, uint16_t);
+void	evdev_support_mt_compat(struct evdev_dev *);
+void	evdev_set_absinfo(struct evdev_dev *, uint16_t,
+	    struct input_absinfo *);
+int	evdev_push_event(struct evdev_dev *, uint16_t, uint16_t, int32_t);
+void	evdev_push_mt_compat(struct evdev_dev *);
+
+#define	evdev_push_key(evdev, code, value)				\
+	evdev_push_event(evdev, EV_KEY, code, (value) != 0)
+#define	evdev_push_abs(evdev, code, value)				\
+	evdev_push_event(evdev, EV_ABS, code, value)
+#define	evdev_sync(evdev)						\
+	evdev_push_event(evdev, EV_SYN, SYN_REPORT, 1)
+
+#endif /* !_HARNESS_EVDEV_EVDEV_H_ */
@@ -0,0 +1,31 @@
+/* Userspace stand-in for <dev/evdev/input.h>, the codes the driver uses */
+#ifndef _HARNESS_EVDEV_INPUT_H_
+#define	_HARNESS_EVDEV_INPUT_H_
+
+#define	INPUT_PROP_DIRECT	0x01
+
+#define	EV_SYN			0x00
+#define	EV_KEY			0x01
+#define	EV_REL			0x02
+#define	EV_ABS			0x03
+#define	EV_MSC			0x04
+
+#define	SYN_REPORT		0
+
+#define	REL_X			0x00
+#define	REL_Y			0x01
+#define	REL_WHEEL		0x08
+
+#define	ABS_X			0x00
+#define	ABS_Y			0x01
+#define	ABS_MT_SLOT		0x2f
+#define	ABS_MT_POSITION_X	0x35
+#define	ABS_MT_POSITION_Y	0x36
+#define	ABS_MT_TRACKING_ID	0x39
+
+#define	MSC_TIMESTAMP		0x05
+
+#define	BTN_MOUSE		0x110
+#define	BTN_TOUCH		0x14a
+
+#endif /* !_HARNESS_EVDEV_INPUT_H_ */
@@ -0,0 +1,93 @@
+/*
+ * Userspace stand-in for <dev/hid/hid.h>: the item parser interface and
+ * the usages the driver looks for.  The parser itself is in ../hid.c.
+ */
+#ifndef _HARNESS_HID_HID_H_
+#define	_HARNESS_HID_HID_H_
+
+#include <stdint.h>
+
+#define	HUP_GENERIC_DESKTOP	0x0001
+#define	HUP_BUTTON		0x0009
+#define	HUP_DIGITIZERS		0x000d
+
+#define	HUG_POINTER		0x0001
+#define	HUG_MOUSE		0x0002
+#define	HUG_X			0x0030
+#define	HUG_Y			0x0031
+#define	HUG_Z			0x0032
+#define	HUG_WHEEL		0x0038
+#define	HUG_TWHEEL		0x0048
+
+#define	HUD_TOUCHSCREEN		0x0004
+#define	HUD_FINGER		0x0022
+#define	HUD_TIP_SWITCH		0x0042
+#define	HUD_CONTACTID		0x0051
+#define	HUD_CONTACTCOUNT	0x0054
+
+#define	HUM_CENTIMETER		0x11
+#define	HUM_RADIAN		0x12
+#define	HUM_INCH		0x13
+#define	HUM_DEGREE		0x14
+
+#define	HID_USAGE2(p, u)	(((p) << 16) | (u))
+#define	HID_GET_USAGE(u)	((u) & 0xffff)
+#define	HID_GET_USAGE_PAGE(u)	(((u) >> 16) & 0xffff)
+
+#define	HIO_CONST		0x001
+#define	HIO_VARIABLE		0x002
+#define	HIO_RELATIVE		0x004
+
+typedef uint32_t hid_size_t;
+
+enum hid_kind {
+	hid_input, hid_output, hid_feature, hid_collection, hid_endcollection
+};
+
+struct hid_location {
+	uint32_t size;
+	uint32_t count;
+	uint32_t pos;
+};
+
+struct hid_item {
+	/* Global */
+	uint32_t _usage_page;
+	int32_t	logical_minimum;
+	int32_t	logical_maximum;
+	int32_t	physical_minimum;
+	int32_t	physical_maximum;
+	int32_t	unit_exponent;
+	int32_t	unit;
+	int32_t	report_ID;
+	/* Local */
+	int	nusages;
+	int32_t	usage;
+	int32_t	usage_minimum;
+	int32_t	usage_maximum;
+	int32_t	designator_index;
+	int32_t	designator_minimum;
+	int32_t	designator_maximum;
+	int32_t	string_index;
+	int32_t	string_minimum;
+	int32_t	string_maximum;
+	int32_t	set_delimiter;
+	/* Misc */
+	int32_t	collection;
+	int	collevel;
+	enum hid_kind kind;
+	uint32_t flags;
+	/* Location */
+	struct hid_location loc;
+};
+
+struct hid_data;
+
+struct hid_data *hid_start_parse(const void *, hid_size_t, int);
+void	hid_end_parse(struct hid_data *);
+int	hid_get_item(struct hid_data *, struct hid_item *);
+int32_t	hid_get_data(const uint8_t *, hid_size_t, struct hid_location *);
+uint32_t hid_get_udata(const uint8_t *, hid_size_t, struct hid_location *);
+int32_t	hid_item_resolution(struct hid_item *);
+
+#endif /* !_HARNESS_HID_HID_H_ */
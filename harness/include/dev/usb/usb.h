@@ -0,0 +1 @@
+/* Userspace stand-in for <dev/usb/usb.h>, nothing used */
@@ -0,0 +1,8 @@
+/* Userspace stand-in for <dev/usb/usb_debug.h>, debug printfs compiled out */
+#ifndef _HARNESS_USB_DEBUG_H_
+#define	_HARNESS_USB_DEBUG_H_
+
+#define	DPRINTF(...)		do { } while (0)
+#define	DPRINTFN(n, ...)	do { } while (0)
+
+#endif /* !_HARNESS_USB_DEBUG_H_ */
@@ -0,0 +1,2 @@
+/* Userspace stand-in for <dev/usb/usbhid.h> */
+#include <dev/hid/hid.h>
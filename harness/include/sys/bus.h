@@ -0,0 +1,20 @@
+/* Userspace stand-in for <sys/bus.h> */
+#ifndef _HARNESS_SYS_BUS_H_
+#define	_HARNESS_SYS_BUS_H_
+
+typedef struct device *device_t;
+
+struct sysctl_ctx_list;
+struct sysctl_oid;
+
+const char *device_get_name(device_t);
+int	device_get_unit(device_t);
+const char *device_get_nameunit(device_t);
+const char *device_get_desc(device_t);
+struct sysctl_ctx_list *device_get_sysctl_ctx(device_t);
+struct sysctl_oid *device_get_sysctl_tree(device_t);
+int	device_printf(device_t, const char *, ...)
+	    __attribute__((__format__(__printf__, 2, 3)));
+int	resource_int_value(const char *, int, const char *, int *);
+
+#endif /* !_HARNESS_SYS_BUS_H_ */
@@ -0,0 +1 @@
+/* Userspace stand-in for <sys/callout.h>, nothing used */
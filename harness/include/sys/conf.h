@@ -0,0 +1,55 @@
+/* Userspace stand-in for <sys/conf.h>, character devices */
+#ifndef _HARNESS_SYS_CONF_H_
+#define	_HARNESS_SYS_CONF_H_
+
+#include <sys/types.h>
+
+#include <vm/vm.h>
+
+struct knote;
+struct thread;
+struct uio;
+struct vm_object;
+
+struct cdev {
+	void	*si_drv1;
+};
+
+typedef int d_open_t(struct cdev *, int, int, struct thread *);
+typedef int d_read_t(struct cdev *, struct uio *, int);
+typedef int d_poll_t(struct cdev *, int, struct thread *);
+typedef int d_kqfilter_t(struct cdev *, struct knote *);
+typedef int d_mmap_single_t(struct cdev *, vm_ooffset_t *, vm_size_t,
+    struct vm_object **, int);
+typedef void d_priv_dtor_t(void *);
+
+struct cdevsw {
+	int	d_version;
+	const char *d_name;
+	d_open_t *d_open;
+	d_read_t *d_read;
+	d_poll_t *d_poll;
+	d_kqfilter_t *d_kqfilter;
+	d_mmap_single_t *d_mmap_single;
+};
+
+struct make_dev_args {
+	struct cdevsw *mda_devsw;
+	uid_t	mda_uid;
+	gid_t	mda_gid;
+	int	mda_mode;
+	void	*mda_si_drv1;
+};
+
+#define	D_VERSION	0x17122009
+#define	UID_ROOT	0
+#define	GID_OPERATOR	5
+#define	IO_NDELAY	0x0004
+
+void	make_dev_args_init(struct make_dev_args *);
+int	make_dev_s(struct make_dev_args *, struct cdev **, const char *, ...);
+void	destroy_dev(struct cdev *);
+int	devfs_get_cdevpriv(void **);
+int	devfs_set_cdevpriv(void *, d_priv_dtor_t *);
+
+#endif /* !_HARNESS_SYS_CONF_H_ */
@@ -0,0 +1,11 @@
+/* Userspace stand-in for <sys/cpuset.h> */
+#ifndef _HARNESS_SYS_CPUSET_H_
+#define	_HARNESS_SYS_CPUSET_H_
+
+typedef struct _cpuset {
+	unsigned long __bits[1];
+} cpuset_t;
+
+#define	CPU_SETOF(n, p)		((p)->__bits[0] = 1UL << (n))
+
+#endif /* !_HARNESS_SYS_CPUSET_H_ */
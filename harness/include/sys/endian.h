@@ -0,0 +1,16 @@
+/* Userspace stand-in for <sys/endian.h> */
+#ifndef _HARNESS_SYS_ENDIAN_H_
+#define	_HARNESS_SYS_ENDIAN_H_
+
+#include <stdint.h>
+
+static inline uint32_t
+le32dec(const void *pp)
+{
+	const uint8_t *p = (const uint8_t *)pp;
+
+	return (((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) |
+	    ((uint32_t)p[1] << 8) | p[0]);
+}
+
+#endif /* !_HARNESS_SYS_ENDIAN_H_ */
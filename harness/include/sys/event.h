@@ -0,0 +1,38 @@
+/* Userspace stand-in for <sys/event.h>, kqueue filters */
+#ifndef _HARNESS_SYS_EVENT_H_
+#define	_HARNESS_SYS_EVENT_H_
+
+#include <stdint.h>
+
+struct knote;
+struct mtx;
+
+struct filterops {
+	int	f_isfd;
+	void	(*f_detach)(struct knote *);
+	int	(*f_event)(struct knote *, long);
+};
+
+struct knote {
+	short	kn_filter;
+	unsigned short kn_flags;
+	int64_t	kn_data;
+	struct filterops *kn_fop;
+	void	*kn_hook;
+};
+
+struct knlist {
+	int	kl_unused;
+};
+
+#define	EVFILT_READ		(-1)
+#define	EV_EOF			0x8000
+#define	KNOTE_LOCKED(list, hint) ((void)(list), (void)(hint))
+
+void	knlist_init_mtx(struct knlist *, struct mtx *);
+void	knlist_add(struct knlist *, struct knote *, int);
+void	knlist_remove(struct knlist *, struct knote *, int);
+void	knlist_clear(struct knlist *, int);
+void	knlist_destroy(struct knlist *);
+
+#endif /* !_HARNESS_SYS_EVENT_H_ */
@@ -0,0 +1,11 @@
+/* Userspace stand-in for <sys/fcntl.h>, on top of the libc one */
+#ifndef _HARNESS_SYS_FCNTL_H_
+#define	_HARNESS_SYS_FCNTL_H_
+
+#include_next <sys/fcntl.h>
+
+#ifndef FWRITE
+#define	FWRITE			0x0002
+#endif
+
+#endif /* !_HARNESS_SYS_FCNTL_H_ */
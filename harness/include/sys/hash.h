@@ -0,0 +1,20 @@
+/* Userspace stand-in for <sys/hash.h> */
+#ifndef _HARNESS_SYS_HASH_H_
+#define	_HARNESS_SYS_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define	HASHINIT	5381
+
+static inline uint32_t
+hash32_buf(const void *buf, size_t len, uint32_t hash)
+{
+	const uint8_t *p = buf;
+
+	while (len-- != 0)
+		hash = hash * 33 + *p++;
+	return (hash);
+}
+
+#endif /* !_HARNESS_SYS_HASH_H_ */
@@ -0,0 +1 @@
+/* Userspace stand-in for <sys/kernel.h>, nothing used */
@@ -0,0 +1 @@
+/* Userspace stand-in for <sys/lock.h>, nothing used */
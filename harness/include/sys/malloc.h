@@ -0,0 +1,29 @@
+/*
+ * Userspace stand-in for <sys/malloc.h>.  The kernel malloc(9) and free(9)
+ * take a malloc type, they are mapped to the libc ones.
+ */
+#ifndef _HARNESS_SYS_MALLOC_H_
+#define	_HARNESS_SYS_MALLOC_H_
+
+#include <stddef.h>
+#include <stdlib.h>
+
+struct malloc_type {
+	const char *ks_shortdesc;
+};
+
+#define	M_WAITOK		0x0002
+#define	M_ZERO			0x0100
+
+#define	MALLOC_DEFINE(type, shortdesc, longdesc)			\
+	struct malloc_type type[1] = { { shortdesc } }
+
+extern struct malloc_type M_TEMP[1];
+
+void	*harness_malloc(size_t, struct malloc_type *, int);
+void	harness_free(void *, struct malloc_type *);
+
+#define	malloc(size, type, flags)	harness_malloc(size, type, flags)
+#define	free(addr, type)		harness_free(addr, type)
+
+#endif /* !_HARNESS_SYS_MALLOC_H_ */
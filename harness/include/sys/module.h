@@ -0,0 +1,14 @@
+/* Userspace stand-in for <sys/module.h> */
+#ifndef _HARNESS_SYS_MODULE_H_
+#define	_HARNESS_SYS_MODULE_H_
+
+typedef struct module *module_t;
+
+typedef enum modeventtype {
+	MOD_LOAD,
+	MOD_UNLOAD,
+	MOD_SHUTDOWN,
+	MOD_QUIESCE,
+} modeventtype_t;
+
+#endif /* !_HARNESS_SYS_MODULE_H_ */
@@ -0,0 +1,18 @@
+/* Userspace stand-in for <sys/mutex.h>, single threaded */
+#ifndef _HARNESS_SYS_MUTEX_H_
+#define	_HARNESS_SYS_MUTEX_H_
+
+struct mtx {
+	int	mtx_unused;
+};
+
+#define	MTX_DEF			0x0000
+#define	MA_OWNED		0x0001
+
+#define	MTX_SYSINIT(name, mtx, desc, opts)				\
+	extern int harness_mtx_##name
+#define	mtx_lock(m)		((void)(m))
+#define	mtx_unlock(m)		((void)(m))
+#define	mtx_assert(m, what)	((void)(m))
+
+#endif /* !_HARNESS_SYS_MUTEX_H_ */
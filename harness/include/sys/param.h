@@ -0,0 +1,40 @@
+/*
+ * Userspace stand-in for the bits of the kernel <sys/param.h> the
+ * descriptor parser uses, on top of the libc one.
+ */
+#ifndef _HARNESS_SYS_PARAM_H_
+#define	_HARNESS_SYS_PARAM_H_
+
+#include_next <sys/param.h>
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef __FreeBSD_version
+#define	__FreeBSD_version	1400097
+#endif
+
+typedef int64_t sbintime_t;
+
+#ifndef CACHE_LINE_SIZE
+#define	CACHE_LINE_SIZE		64
+#endif
+#ifndef __aligned
+#define	__aligned(x)		__attribute__((__aligned__(x)))
+#endif
+#ifndef __inline
+#define	__inline		inline
+#endif
+#ifndef __DECONST
+#define	__DECONST(type, var)	((type)(uintptr_t)(const void *)(var))
+#endif
+#ifndef nitems
+#define	nitems(x)		(sizeof((x)) / sizeof((x)[0]))
+#endif
+#ifndef roundup2
+#define	roundup2(x, y)		(((x) + ((y) - 1)) & ~((y) - 1))
+#endif
+
+#endif /* !_HARNESS_SYS_PARAM_H_ */
@@ -0,0 +1,9 @@
+/* Userspace stand-in for <sys/priority.h> */
+#ifndef _HARNESS_SYS_PRIORITY_H_
+#define	_HARNESS_SYS_PRIORITY_H_
+
+#define	PRI_MIN			0
+#define	PRI_MAX_KERN		119
+#define	PI_SOFT			40
+
+#endif /* !_HARNESS_SYS_PRIORITY_H_ */
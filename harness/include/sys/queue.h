@@ -0,0 +1,23 @@
+/*
+ * Userspace stand-in for <sys/queue.h>, on top of the libc one, which
+ * lacks the _SAFE loops.
+ */
+#ifndef _HARNESS_SYS_QUEUE_H_
+#define	_HARNESS_SYS_QUEUE_H_
+
+#include_next <sys/queue.h>
+
+#ifndef TAILQ_FOREACH_SAFE
+#define	TAILQ_FOREACH_SAFE(var, head, field, tvar)			\
+	for ((var) = TAILQ_FIRST((head));				\
+	    (var) && ((tvar) = TAILQ_NEXT((var), field), 1);		\
+	    (var) = (tvar))
+#endif
+#ifndef TAILQ_FOREACH_REVERSE_SAFE
+#define	TAILQ_FOREACH_REVERSE_SAFE(var, head, headname, field, tvar)	\
+	for ((var) = TAILQ_LAST((head), headname);			\
+	    (var) && ((tvar) = TAILQ_PREV((var), headname, field), 1);	\
+	    (var) = (tvar))
+#endif
+
+#endif /* !_HARNESS_SYS_QUEUE_H_ */
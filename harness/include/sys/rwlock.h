@@ -0,0 +1 @@
+/* Userspace stand-in for <sys/rwlock.h>, nothing used */
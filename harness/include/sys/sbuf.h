@@ -0,0 +1,18 @@
+/* Userspace stand-in for <sys/sbuf.h>, the calls the driver makes */
+#ifndef _HARNESS_SYS_SBUF_H_
+#define	_HARNESS_SYS_SBUF_H_
+
+struct sbuf;
+struct sysctl_req;
+
+struct sbuf	*sbuf_new_auto(void);
+struct sbuf	*sbuf_new_for_sysctl(struct sbuf *, char *, int,
+		    struct sysctl_req *);
+int		 sbuf_printf(struct sbuf *, const char *, ...)
+		    __attribute__((__format__(__printf__, 2, 3)));
+int		 sbuf_finish(struct sbuf *);
+char		*sbuf_data(struct sbuf *);
+ssize_t		 sbuf_len(struct sbuf *);
+void		 sbuf_delete(struct sbuf *);
+
+#endif /* !_HARNESS_SYS_SBUF_H_ */
@@ -0,0 +1,14 @@
+/* Userspace stand-in for <sys/sdt.h>, probes compiled out */
+#ifndef _HARNESS_SYS_SDT_H_
+#define	_HARNESS_SYS_SDT_H_
+
+#define	SDT_PROVIDER_DEFINE(prov)					\
+	extern int harness_sdt_##prov
+#define	SDT_PROBE_DEFINE2(prov, mod, func, name, t0, t1)		\
+	extern int harness_sdt_##prov##_##mod##_##func##_##name
+#define	SDT_PROBE_DEFINE3(prov, mod, func, name, t0, t1, t2)		\
+	extern int harness_sdt_##prov##_##mod##_##func##_##name
+#define	SDT_PROBE2(prov, mod, func, name, a0, a1) do { } while (0)
+#define	SDT_PROBE3(prov, mod, func, name, a0, a1, a2) do { } while (0)
+
+#endif /* !_HARNESS_SYS_SDT_H_ */
@@ -0,0 +1,17 @@
+/* Userspace stand-in for <sys/selinfo.h> */
+#ifndef _HARNESS_SYS_SELINFO_H_
+#define	_HARNESS_SYS_SELINFO_H_
+
+#include <sys/event.h>
+
+struct thread;
+
+struct selinfo {
+	struct knlist si_note;
+};
+
+void	selrecord(struct thread *, struct selinfo *);
+void	selwakeup(struct selinfo *);
+void	seldrain(struct selinfo *);
+
+#endif /* !_HARNESS_SYS_SELINFO_H_ */
@@ -0,0 +1,11 @@
+/* Userspace stand-in for <sys/smp.h> */
+#ifndef _HARNESS_SYS_SMP_H_
+#define	_HARNESS_SYS_SMP_H_
+
+#include <sys/types.h>
+
+extern u_int mp_maxid;
+
+#define	CPU_ABSENT(cpu)		((u_int)(cpu) > mp_maxid)
+
+#endif /* !_HARNESS_SYS_SMP_H_ */
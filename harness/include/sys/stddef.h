@@ -0,0 +1,2 @@
+/* Userspace stand-in for <sys/stddef.h> */
+#include <stddef.h>
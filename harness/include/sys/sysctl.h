@@ -0,0 +1,58 @@
+/*
+ * Userspace stand-in for <sys/sysctl.h>.  Nodes are not created, the
+ * handlers are only referenced.
+ */
+#ifndef _HARNESS_SYS_SYSCTL_H_
+#define	_HARNESS_SYS_SYSCTL_H_
+
+#include <stdint.h>
+
+struct sysctl_ctx_list;
+struct sysctl_oid;
+struct sysctl_oid_list;
+
+struct sysctl_req {
+	void	*newptr;
+};
+
+#define	CTLTYPE_INT		2
+#define	CTLTYPE_STRING		3
+#define	CTLFLAG_RD		0x80000000
+#define	CTLFLAG_WR		0x40000000
+#define	CTLFLAG_RW		(CTLFLAG_RD | CTLFLAG_WR)
+#define	CTLFLAG_TUN		0x00080000
+#define	CTLFLAG_RDTUN		(CTLFLAG_RD | CTLFLAG_TUN)
+#define	CTLFLAG_RWTUN		(CTLFLAG_RW | CTLFLAG_TUN)
+#define	CTLFLAG_MPSAFE		0x00040000
+#define	OID_AUTO		(-1)
+
+#define	SYSCTL_HANDLER_ARGS						\
+	struct sysctl_oid *oidp, void *arg1, intmax_t arg2,		\
+	struct sysctl_req *req
+
+#define	SYSCTL_DECL(name)	extern int sysctl_##name
+#define	SYSCTL_NODE(parent, nbr, name, ...)				\
+	SYSCTL_DECL(parent##_##name)
+#define	SYSCTL_INT(parent, nbr, name, access, ptr, val, descr)		\
+	static const void *const sysctl_##parent##_##name		\
+	    __attribute__((__unused__)) = (ptr)
+#define	SYSCTL_U64		SYSCTL_INT
+#define	SYSCTL_OPAQUE(parent, nbr, name, access, ptr, len, fmt, descr)	\
+	SYSCTL_INT(parent, nbr, name, access, ptr, 0, descr)
+
+#define	SYSCTL_CHILDREN(oid)	((struct sysctl_oid_list *)(oid))
+#define	SYSCTL_ADD_INT(ctx, parent, nbr, name, access, ptr, val, descr) \
+	((void)(ctx), (void)(ptr))
+#define	SYSCTL_ADD_UINT		SYSCTL_ADD_INT
+#define	SYSCTL_ADD_U64		SYSCTL_ADD_INT
+#define	SYSCTL_ADD_OPAQUE(ctx, parent, nbr, name, access, ptr, len, fmt, \
+	    descr)							\
+	((void)(ctx), (void)(ptr))
+#define	SYSCTL_ADD_PROC(ctx, parent, nbr, name, access, arg1, arg2,	\
+	    handler, fmt, descr)					\
+	((void)(ctx), (void)(arg1), (void)(handler))
+
+int	sysctl_handle_int(struct sysctl_oid *, void *, intmax_t,
+	    struct sysctl_req *);
+
+#endif /* !_HARNESS_SYS_SYSCTL_H_ */
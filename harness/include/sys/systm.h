@@ -0,0 +1,55 @@
+/* Userspace stand-in for <sys/systm.h> and the libkern calls used */
+#ifndef _HARNESS_SYS_SYSTM_H_
+#define	_HARNESS_SYS_SYSTM_H_
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct mtx;
+
+#define	KASSERT(exp, msg)	assert(exp)
+#define	CTASSERT(x)		_Static_assert(x, "compile-time assertion failed")
+
+#define	PCATCH			0x100
+
+#define	atomic_thread_fence_rel()	__atomic_thread_fence(__ATOMIC_RELEASE)
+#define	atomic_store_rel_64(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+void	hexdump(const void *, int, const char *, int);
+int	msleep(void *, struct mtx *, int, const char *, int);
+void	wakeup(void *);
+
+#ifndef __FreeBSD__
+static inline int
+fls(int mask)
+{
+
+	return (mask == 0 ? 0 : 32 - __builtin_clz((unsigned int)mask));
+}
+
+static inline int
+flsll(long long mask)
+{
+
+	return (mask == 0 ? 0 :
+	    64 - __builtin_clzll((unsigned long long)mask));
+}
+
+static inline size_t
+strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (size != 0) {
+		size = len < size ? len : size - 1;
+		memcpy(dst, src, size);
+		dst[size] = '\0';
+	}
+	return (len);
+}
+#endif
+
+#endif /* !_HARNESS_SYS_SYSTM_H_ */
@@ -0,0 +1,31 @@
+/* Userspace stand-in for <sys/taskqueue.h>, tasks are never run */
+#ifndef _HARNESS_SYS_TASKQUEUE_H_
+#define	_HARNESS_SYS_TASKQUEUE_H_
+
+struct _cpuset;
+struct taskqueue;
+
+typedef void task_fn_t(void *, int);
+
+struct task {
+	task_fn_t *ta_func;
+	void	*ta_context;
+};
+
+#define	TASK_INIT(task, prio, func, context) do {			\
+	(task)->ta_func = (func);					\
+	(task)->ta_context = (context);					\
+} while (0)
+
+struct taskqueue *taskqueue_create(const char *, int,
+	    void (*)(void *), void *);
+void	taskqueue_thread_enqueue(void *);
+int	taskqueue_start_threads(struct taskqueue **, int, int, const char *,
+	    ...);
+int	taskqueue_start_threads_cpuset(struct taskqueue **, int, int,
+	    struct _cpuset *, const char *, ...);
+int	taskqueue_enqueue(struct taskqueue *, struct task *);
+void	taskqueue_drain(struct taskqueue *, struct task *);
+void	taskqueue_free(struct taskqueue *);
+
+#endif /* !_HARNESS_SYS_TASKQUEUE_H_ */
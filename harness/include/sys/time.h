@@ -0,0 +1,42 @@
+/*
+ * Userspace stand-in for the kernel sbintime_t clock of <sys/time.h>, on
+ * top of the libc one.
+ */
+#ifndef _HARNESS_SYS_TIME_H_
+#define	_HARNESS_SYS_TIME_H_
+
+#include_next <sys/time.h>
+
+#include <sys/param.h>
+#include <time.h>
+
+static __inline sbintime_t
+sbinuptime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (((sbintime_t)ts.tv_sec << 32) +
+	    (((uint64_t)ts.tv_nsec << 32) / 1000000000));
+}
+
+#define	SBT_1S			((sbintime_t)1 << 32)
+#define	SBT_1MS			(SBT_1S / 1000)
+
+static __inline int64_t
+sbttons(sbintime_t sbt)
+{
+
+	return ((sbt >> 32) * 1000000000 +
+	    (int64_t)(((sbt & 0xffffffff) * 1000000000) >> 32));
+}
+
+static __inline int64_t
+sbttous(sbintime_t sbt)
+{
+
+	return ((sbt >> 32) * 1000000 +
+	    (int64_t)(((sbt & 0xffffffff) * 1000000) >> 32));
+}
+
+#endif /* !_HARNESS_SYS_TIME_H_ */
@@ -0,0 +1,13 @@
+/* Userspace stand-in for <sys/uio.h>, on top of the libc one */
+#ifndef _HARNESS_SYS_UIO_H_
+#define	_HARNESS_SYS_UIO_H_
+
+#include_next <sys/uio.h>
+
+struct uio {
+	ssize_t	uio_resid;
+};
+
+int	uiomove(void *, int, struct uio *);
+
+#endif /* !_HARNESS_SYS_UIO_H_ */
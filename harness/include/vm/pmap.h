@@ -0,0 +1,10 @@
+/* Userspace stand-in for <vm/pmap.h> */
+#ifndef _HARNESS_VM_PMAP_H_
+#define	_HARNESS_VM_PMAP_H_
+
+#include <vm/vm.h>
+
+void	pmap_qenter(vm_offset_t, vm_page_t *, int);
+void	pmap_qremove(vm_offset_t, int);
+
+#endif /* !_HARNESS_VM_PMAP_H_ */
@@ -0,0 +1,19 @@
+/* Userspace stand-in for <vm/vm.h> */
+#ifndef _HARNESS_VM_VM_H_
+#define	_HARNESS_VM_VM_H_
+
+#include <stdint.h>
+
+typedef struct vm_object *vm_object_t;
+typedef struct vm_page *vm_page_t;
+typedef uintptr_t vm_offset_t;
+typedef uintptr_t vm_size_t;
+typedef uint64_t vm_ooffset_t;
+typedef uint64_t vm_pindex_t;
+typedef uint8_t vm_prot_t;
+
+#define	VM_PROT_READ		((vm_prot_t)0x01)
+#define	VM_PROT_WRITE		((vm_prot_t)0x02)
+#define	VM_PROT_DEFAULT		(VM_PROT_READ | VM_PROT_WRITE)
+
+#endif /* !_HARNESS_VM_VM_H_ */
@@ -0,0 +1,10 @@
+/* Userspace stand-in for <vm/vm_extern.h> */
+#ifndef _HARNESS_VM_VM_EXTERN_H_
+#define	_HARNESS_VM_VM_EXTERN_H_
+
+#include <vm/vm.h>
+
+vm_offset_t kva_alloc(vm_size_t);
+void	kva_free(vm_offset_t, vm_size_t);
+
+#endif /* !_HARNESS_VM_VM_EXTERN_H_ */
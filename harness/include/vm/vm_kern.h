@@ -0,0 +1 @@
+/* Userspace stand-in for <vm/vm_kern.h>, nothing used */
@@ -0,0 +1,14 @@
+/* Userspace stand-in for <vm/vm_object.h> */
+#ifndef _HARNESS_VM_VM_OBJECT_H_
+#define	_HARNESS_VM_VM_OBJECT_H_
+
+#include <vm/vm.h>
+
+#define	OBJT_PHYS		3
+#define	VM_OBJECT_WLOCK(obj)	((void)(obj))
+#define	VM_OBJECT_WUNLOCK(obj)	((void)(obj))
+
+void	vm_object_reference(vm_object_t);
+void	vm_object_deallocate(vm_object_t);
+
+#endif /* !_HARNESS_VM_VM_OBJECT_H_ */
@@ -0,0 +1,19 @@
+/* Userspace stand-in for <vm/vm_page.h> */
+#ifndef _HARNESS_VM_VM_PAGE_H_
+#define	_HARNESS_VM_VM_PAGE_H_
+
+#include <vm/vm.h>
+
+struct vm_page {
+	int	valid;
+};
+
+#define	VM_ALLOC_NOBUSY		0x0200
+#define	VM_ALLOC_ZERO		0x0040
+#define	VM_PAGE_BITS_ALL	0xffff
+
+vm_page_t vm_page_grab(vm_object_t, vm_pindex_t, int);
+void	vm_page_valid(vm_page_t);
+void	vm_page_xunbusy(vm_page_t);
+
+#endif /* !_HARNESS_VM_VM_PAGE_H_ */
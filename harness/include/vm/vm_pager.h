@@ -0,0 +1,12 @@
+/* Userspace stand-in for <vm/vm_pager.h> */
+#ifndef _HARNESS_VM_VM_PAGER_H_
+#define	_HARNESS_VM_VM_PAGER_H_
+
+#include <vm/vm.h>
+
+struct ucred;
+
+vm_object_t vm_pager_allocate(int, void *, vm_ooffset_t, vm_prot_t,
+	    vm_ooffset_t, struct ucred *);
+
+#endif /* !_HARNESS_VM_VM_PAGER_H_ */
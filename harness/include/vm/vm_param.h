@@ -0,0 +1,11 @@
+/* Userspace stand-in for <vm/vm_param.h> */
+#ifndef _HARNESS_VM_VM_PARAM_H_
+#define	_HARNESS_VM_VM_PARAM_H_
+
+#ifndef PAGE_SIZE
+#define	PAGE_SIZE		4096
+#endif
+#define	round_page(x)		roundup2(x, PAGE_SIZE)
+#define	atop(x)			((x) / PAGE_SIZE)
+
+#endif /* !_HARNESS_VM_VM_PARAM_H_ */
@@ -0,0 +1,511 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Userspace stand-ins for the kernel interfaces utouch_core.c calls, so
+ * that the decode path can be run and timed as compiled for the kernel.
+ * evdev devices count the events pushed to them, the taskqueue, knote,
+ * select and VM calls do nothing: decode.c does not enable deferred
+ * decoding or the raw device.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/conf.h>
+#include <sys/cpuset.h>
+#include <sys/event.h>
+#include <sys/malloc.h>
+#include <sys/sbuf.h>
+#include <sys/selinfo.h>
+#include <sys/smp.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/uio.h>
+
+#include <vm/vm.h>
+#include <vm/vm_extern.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_pager.h>
+#include <vm/pmap.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <dev/evdev/evdev.h>
+
+#include "harness.h"
+
+struct evdev_dev {
+	const struct evdev_methods *ev_methods;
+	void	*ev_softc;
+	uint64_t ev_events;
+};
+
+struct malloc_type M_TEMP[1] = { { "temp" } };
+u_int mp_maxid = 0;
+
+/* Cache line aligned, the softc and plan structures ask for it */
+void *
+harness_malloc(size_t size, struct malloc_type *type, int flags)
+{
+	void *p;
+
+	p = aligned_alloc(CACHE_LINE_SIZE, roundup(size, CACHE_LINE_SIZE));
+	if (p == NULL)
+		abort();
+	if (flags & M_ZERO)
+		memset(p, 0, size);
+	return (p);
+}
+
+void
+harness_free(void *addr, struct malloc_type *type)
+{
+
+	(free)(addr);
+}
+
+const char *
+device_get_name(device_t dev)
+{
+
+	return ("utouch");
+}
+
+int
+device_get_unit(device_t dev)
+{
+
+	return (0);
+}
+
+const char *
+device_get_nameunit(device_t dev)
+{
+
+	return ("utouch0");
+}
+
+const char *
+device_get_desc(device_t dev)
+{
+
+	return ("harness");
+}
+
+struct sysctl_ctx_list *
+device_get_sysctl_ctx(device_t dev)
+{
+
+	return (NULL);
+}
+
+struct sysctl_oid *
+device_get_sysctl_tree(device_t dev)
+{
+
+	return (NULL);
+}
+
+int
+device_printf(device_t dev, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	fprintf(stderr, "%s: ", device_get_nameunit(dev));
+	va_start(ap, fmt);
+	n = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	return (n);
+}
+
+/* No device hints */
+int
+resource_int_value(const char *name, int unit, const char *resname,
+    int *result)
+{
+
+	return (ENOENT);
+}
+
+struct sbuf *
+sbuf_new_for_sysctl(struct sbuf *s, char *buf, int length,
+    struct sysctl_req *req)
+{
+
+	return (sbuf_new_auto());
+}
+
+int
+sysctl_handle_int(struct sysctl_oid *oidp, void *arg1, intmax_t arg2,
+    struct sysctl_req *req)
+{
+
+	return (0);
+}
+
+struct evdev_dev *
+evdev_alloc(void)
+{
+
+	return (calloc(1, sizeof(struct evdev_dev)));
+}
+
+void
+evdev_free(struct evdev_dev *evdev)
+{
+
+	(free)(evdev);
+}
+
+void
+evdev_set_name(struct evdev_dev *evdev, const char *name)
+{
+}
+
+void
+evdev_set_phys(struct evdev_dev *evdev, const char *name)
+{
+}
+
+void
+evdev_set_id(struct evdev_dev *evdev, uint16_t bustype, uint16_t vendor,
+    uint16_t product, uint16_t version)
+{
+}
+
+void
+evdev_set_serial(struct evdev_dev *evdev, const char *serial)
+{
+}
+
+void
+evdev_set_methods(struct evdev_dev *evdev, void *softc,
+    const struct evdev_methods *methods)
+{
+
+	evdev->ev_softc = softc;
+	evdev->ev_methods = methods;
+}
+
+void *
+evdev_get_softc(struct evdev_dev *evdev)
+{
+
+	return (evdev->ev_softc);
+}
+
+int
+evdev_register_mtx(struct evdev_dev *evdev, struct mtx *mtx)
+{
+
+	return (0);
+}
+
+void
+evdev_support_prop(struct evdev_dev *evdev, uint16_t prop)
+{
+}
+
+void
+evdev_support_event(struct evdev_dev *evdev, uint16_t type)
+{
+}
+
+void
+evdev_support_key(struct evdev_dev *evdev, uint16_t code)
+{
+}
+
+void
+evdev_support_rel(struct evdev_dev *evdev, uint16_t code)
+{
+}
+
+void
+evdev_support_abs(struct evdev_dev *evdev, uint16_t code, int32_t minimum,
+    int32_t maximum, int32_t fuzz, int32_t flat, int32_t resolution)
+{
+}
+
+void
+evdev_support_msc(struct evdev_dev *evdev, uint16_t code)
+{
+}
+
+void
+evdev_support_mt_compat(struct evdev_dev *evdev)
+{
+}
+
+void
+evdev_set_absinfo(struct evdev_dev *evdev, uint16_t code,
+    struct input_absinfo *absinfo)
+{
+}
+
+int
+evdev_push_event(struct evdev_dev *evdev, uint16_t type, uint16_t code,
+    int32_t value)
+{
+
+	evdev->ev_events++;
+	return (0);
+}
+
+void
+evdev_push_mt_compat(struct evdev_dev *evdev)
+{
+}
+
+/* What evdev does on the first open(2) of the device node */
+int
+harness_evdev_open(struct evdev_dev *evdev)
+{
+
+	return (evdev->ev_methods->ev_open(evdev));
+}
+
+uint64_t
+harness_evdev_events(struct evdev_dev *evdev)
+{
+
+	return (evdev->ev_events);
+}
+
+struct taskqueue *
+taskqueue_create(const char *name, int mflags,
+    void (*enqueue)(void *), void *context)
+{
+
+	return (NULL);
+}
+
+void
+taskqueue_thread_enqueue(void *context)
+{
+}
+
+int
+taskqueue_start_threads(struct taskqueue **tqp, int count, int pri,
+    const char *name, ...)
+{
+
+	return (0);
+}
+
+int
+taskqueue_start_threads_cpuset(struct taskqueue **tqp, int count, int pri,
+    cpuset_t *mask, const char *name, ...)
+{
+
+	return (0);
+}
+
+int
+taskqueue_enqueue(struct taskqueue *queue, struct task *task)
+{
+
+	return (0);
+}
+
+void
+taskqueue_drain(struct taskqueue *queue, struct task *task)
+{
+}
+
+void
+taskqueue_free(struct taskqueue *queue)
+{
+}
+
+void
+knlist_init_mtx(struct knlist *knl, struct mtx *lock)
+{
+}
+
+void
+knlist_add(struct knlist *knl, struct knote *kn, int islocked)
+{
+}
+
+void
+knlist_remove(struct knlist *knl, struct knote *kn, int islocked)
+{
+}
+
+void
+knlist_clear(struct knlist *knl, int islocked)
+{
+}
+
+void
+knlist_destroy(struct knlist *knl)
+{
+}
+
+void
+selrecord(struct thread *td, struct selinfo *sip)
+{
+}
+
+void
+selwakeup(struct selinfo *sip)
+{
+}
+
+void
+seldrain(struct selinfo *sip)
+{
+}
+
+void
+make_dev_args_init(struct make_dev_args *args)
+{
+
+	memset(args, 0, sizeof(*args));
+}
+
+int
+make_dev_s(struct make_dev_args *args, struct cdev **cdev,
+    const char *fmt, ...)
+{
+
+	return (ENXIO);
+}
+
+void
+destroy_dev(struct cdev *dev)
+{
+}
+
+int
+devfs_get_cdevpriv(void **datap)
+{
+
+	return (ENOENT);
+}
+
+int
+devfs_set_cdevpriv(void *priv, d_priv_dtor_t *dtor)
+{
+
+	return (EBUSY);
+}
+
+int
+uiomove(void *cp, int n, struct uio *uio)
+{
+
+	return (EFAULT);
+}
+
+int
+msleep(void *chan, struct mtx *mtx, int pri, const char *wmesg, int timo)
+{
+
+	return (EWOULDBLOCK);
+}
+
+void
+wakeup(void *chan)
+{
+}
+
+void
+hexdump(const void *ptr, int length, const char *hdr, int flags)
+{
+	const uint8_t *p = ptr;
+	int i;
+
+	fprintf(stderr, "%s", hdr != NULL ? hdr : "");
+	for (i = 0; i < length; i++)
+		fprintf(stderr, " %02x", p[i]);
+	fprintf(stderr, "\n");
+}
+
+vm_offset_t
+kva_alloc(vm_size_t size)
+{
+
+	return (0);
+}
+
+void
+kva_free(vm_offset_t addr, vm_size_t size)
+{
+}
+
+void
+pmap_qenter(vm_offset_t va, vm_page_t *m, int count)
+{
+}
+
+void
+pmap_qremove(vm_offset_t va, int count)
+{
+}
+
+vm_object_t
+vm_pager_allocate(int type, void *handle, vm_ooffset_t size, vm_prot_t prot,
+    vm_ooffset_t off, struct ucred *cred)
+{
+
+	return (NULL);
+}
+
+vm_page_t
+vm_page_grab(vm_object_t object, vm_pindex_t pindex, int allocflags)
+{
+
+	return (NULL);
+}
+
+void
+vm_page_valid(vm_page_t m)
+{
+}
+
+void
+vm_page_xunbusy(vm_page_t m)
+{
+}
+
+void
+vm_object_reference(vm_object_t object)
+{
+}
+
+void
+vm_object_deallocate(vm_object_t object)
+{
+}
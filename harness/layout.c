@@ -0,0 +1,336 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Cache lines a report touches.  Lists the softc and plan fields the
+ * input path reads or writes for a tablet report (no report ID, 3 buttons,
+ * X and Y, decoded in the USB callback, raw device, verifier and lock
+ * profiling off) and counts the distinct lines they fall in, decode state
+ * and statistics apart, which is what the layout in utouch.h is meant to
+ * keep down.
+ *
+ * It then replays these accesses with the softc and the plan flushed from
+ * the cache and with them cached, and prints the median cycles of each.
+ * With -n the replay is repeated that many times, for running under
+ * pmcstat(8) or perf-stat(1) to count the cache misses.  x86 only.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/endian.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/queue.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+
+#include <vm/vm.h>
+
+#include <err.h>
+#include <stdlib.h>
+#include <unistd.h>
+#if defined(__amd64__) || defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define	LAYOUT_MEASURE
+#endif
+
+#include <dev/hid/hid.h>
+
+#include "utouch.h"
+
+#define	LAYOUT_REPORT_LEN	6	/* QEMU usb-tablet report */
+#define	LAYOUT_BUTTONS		3
+#define	LAYOUT_FIELDS		(LAYOUT_BUTTONS + 2)
+#define	LAYOUT_ARRIVAL_BUCKET	13	/* 8 ms interval */
+#define	LAYOUT_LAT_BUCKET	6	/* 50 us to sync */
+#define	LAYOUT_RUNS		10001
+#define	LAYOUT_LINES_MAX	256	/* of the softc and of the plan */
+
+enum {
+	LAYOUT_DECODE,		/* softc decode state */
+	LAYOUT_STATS,		/* softc statistics */
+	LAYOUT_PLAN,
+	LAYOUT_NKINDS,
+};
+
+struct layout_ref {
+	const char *lr_name;
+	int	lr_kind;
+	size_t	lr_off;
+	size_t	lr_size;
+};
+
+#define	SC(f)		{ #f, LAYOUT_DECODE,				\
+			    offsetof(struct utouch_softc, f),		\
+			    sizeof(((struct utouch_softc *)0)->f) }
+#define	SCN(f, i, n)	{ #f, LAYOUT_DECODE,				\
+			    offsetof(struct utouch_softc, f) +		\
+			    (i) * sizeof(((struct utouch_softc *)0)->f[0]),	\
+			    (n) * sizeof(((struct utouch_softc *)0)->f[0]) }
+#define	ST(f)		{ #f, LAYOUT_STATS,				\
+			    offsetof(struct utouch_softc, f),		\
+			    sizeof(((struct utouch_softc *)0)->f) }
+#define	STN(f, i)	{ #f, LAYOUT_STATS,				\
+			    offsetof(struct utouch_softc, f) +		\
+			    (i) * sizeof(((struct utouch_softc *)0)->f[0]),	\
+			    sizeof(((struct utouch_softc *)0)->f[0]) }
+#define	EV(f)		{ "sc_ev[0]." #f, LAYOUT_DECODE,		\
+			    offsetof(struct utouch_softc, sc_ev) +		\
+			    offsetof(struct utouch_ev, f),			\
+			    sizeof(((struct utouch_ev *)0)->f) }
+#define	EVN(f, i, n)	{ "sc_ev[0]." #f, LAYOUT_DECODE,		\
+			    offsetof(struct utouch_softc, sc_ev) +		\
+			    offsetof(struct utouch_ev, f) +			\
+			    (i) * sizeof(((struct utouch_ev *)0)->f[0]),	\
+			    (n) * sizeof(((struct utouch_ev *)0)->f[0]) }
+#define	UA(f)		{ "sc_arrival[0]." #f, LAYOUT_STATS,		\
+			    offsetof(struct utouch_softc, sc_arrival) +	\
+			    offsetof(struct utouch_arrival, f),		\
+			    sizeof(((struct utouch_arrival *)0)->f) }
+#define	UAN(f, i)	{ "sc_arrival[0]." #f, LAYOUT_STATS,		\
+			    offsetof(struct utouch_softc, sc_arrival) +	\
+			    offsetof(struct utouch_arrival, f) +		\
+			    (i) * sizeof(((struct utouch_arrival *)0)->f[0]),	\
+			    sizeof(((struct utouch_arrival *)0)->f[0]) }
+#define	UP(f)		{ #f, LAYOUT_PLAN,				\
+			    offsetof(struct utouch_plan, f),		\
+			    sizeof(((struct utouch_plan *)0)->f) }
+#define	UPN(f, i)	{ #f, LAYOUT_PLAN,				\
+			    offsetof(struct utouch_plan, f) +		\
+			    (i) * sizeof(((struct utouch_plan *)0)->f[0]),	\
+			    sizeof(((struct utouch_plan *)0)->f[0]) }
+#define	UC(f)		{ "up_colls[0]." #f, LAYOUT_PLAN,		\
+			    offsetof(struct utouch_plan, up_colls) +	\
+			    offsetof(struct utouch_coll, f),		\
+			    sizeof(((struct utouch_coll *)0)->f) }
+#define	UCN(f, n)	{ "up_colls[0]." #f, LAYOUT_PLAN,		\
+			    offsetof(struct utouch_plan, up_colls) +	\
+			    offsetof(struct utouch_coll, f),		\
+			    (n) * sizeof(((struct utouch_coll *)0)->f[0]) }
+
+static const struct layout_ref layout_refs[] = {
+	/* utouch_core_input() */
+	SC(sc_lock),
+	SC(sc_reports),
+	SC(sc_plan),
+	UP(up_flags),
+	ST(sc_narrival),
+	STN(sc_arrival_ids, 0),
+	UA(ua_last),
+	UA(ua_count),
+	UA(ua_avg),
+	UA(ua_dev),
+	UAN(ua_hist, LAYOUT_ARRIVAL_BUCKET),
+	SC(sc_flags),
+	SC(sc_queue),
+	/* utouch_decode() */
+	UP(up_rdlen),
+	SCN(sc_temp, 0, LAYOUT_REPORT_LEN + sizeof(uint32_t)),
+	UPN(up_coll_by_id, 0),
+	SC(sc_ev_opened),
+	EV(ue_coll),
+	UC(uc_nfields),
+	UCN(uc_fields, LAYOUT_FIELDS),
+	EV(ue_abs),
+	EV(ue_fuzz),
+	EVN(ue_last, 0, LAYOUT_BUTTONS),
+	EV(ue_btn_end),
+	SC(sc_filtered),
+	UC(uc_flags),
+	EV(ue_sc),
+	EV(ue_evdev),
+	EV(ue_unsynced),
+	SC(sc_events),
+	EV(ue_index),
+	SC(sc_syncs),
+	STN(sc_lat_hist, LAYOUT_LAT_BUCKET),
+};
+
+static const char *layout_kinds[LAYOUT_NKINDS] = {
+	[LAYOUT_DECODE] = "softc decode state",
+	[LAYOUT_STATS] = "softc statistics",
+	[LAYOUT_PLAN] = "plan",
+};
+
+#ifdef LAYOUT_MEASURE
+static uint64_t layout_sink;
+
+static int
+layout_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y);
+}
+
+static void
+layout_flush(const uint8_t *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i += CACHE_LINE_SIZE)
+		_mm_clflush(p + i);
+}
+
+/*
+ * Read the first and the last byte of every reference and return the
+ * cycles it took.  The bytes are zero and each address depends on the
+ * previous read, so that the misses do not overlap and the time grows
+ * with the lines missed, as it does on the pointer chains of the input
+ * path.
+ */
+static uint64_t
+layout_replay(const uint8_t *sc, const uint8_t *plan)
+{
+	const struct layout_ref *lr;
+	const volatile uint8_t *p;
+	uint64_t t0, t1;
+	u_int i, dep;
+
+	_mm_mfence();
+	_mm_lfence();
+	t0 = __rdtsc();
+	_mm_lfence();
+	dep = 0;
+	for (i = 0; i < nitems(layout_refs); i++) {
+		lr = &layout_refs[i];
+		p = (lr->lr_kind == LAYOUT_PLAN ? plan : sc) + lr->lr_off + dep;
+		dep = p[0];
+		dep += p[lr->lr_size - 1 + dep];
+	}
+	_mm_lfence();
+	t1 = __rdtsc();
+	layout_sink += dep;
+	return (t1 - t0);
+}
+
+static void
+layout_measure(u_long runs)
+{
+	uint64_t *cold, *warm;
+	uint8_t *sc, *plan;
+	u_long i;
+
+	sc = aligned_alloc(CACHE_LINE_SIZE,
+	    roundup(sizeof(struct utouch_softc), CACHE_LINE_SIZE));
+	plan = aligned_alloc(CACHE_LINE_SIZE,
+	    roundup(sizeof(struct utouch_plan), CACHE_LINE_SIZE));
+	cold = calloc(runs, sizeof(*cold));
+	warm = calloc(runs, sizeof(*warm));
+	if (sc == NULL || plan == NULL || cold == NULL || warm == NULL)
+		err(1, "malloc");
+	memset(sc, 0, sizeof(struct utouch_softc));
+	memset(plan, 0, sizeof(struct utouch_plan));
+
+	for (i = 0; i < runs; i++) {
+		layout_flush(sc, sizeof(struct utouch_softc));
+		layout_flush(plan, sizeof(struct utouch_plan));
+		cold[i] = layout_replay(sc, plan);
+		warm[i] = layout_replay(sc, plan);
+	}
+	qsort(cold, runs, sizeof(*cold), layout_cmp);
+	qsort(warm, runs, sizeof(*warm), layout_cmp);
+	printf("cycles per report, median of %lu: %ju cold, %ju cached\n",
+	    runs, (uintmax_t)cold[runs / 2], (uintmax_t)warm[runs / 2]);
+
+	free(warm);
+	free(cold);
+	free(plan);
+	free(sc);
+}
+#endif
+
+int
+main(int argc, char **argv)
+{
+	static uint8_t lines[LAYOUT_NKINDS][LAYOUT_LINES_MAX];
+	const struct layout_ref *lr;
+	u_long runs;
+	size_t l;
+	u_int i, k, n, total;
+	int ch;
+
+	runs = LAYOUT_RUNS;
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			runs = strtoul(optarg, NULL, 0);
+			if (runs == 0)
+				errx(1, "bad run count %s", optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: utouch_layout [-n runs]\n");
+			return (1);
+		}
+	}
+
+	printf("softc %zu bytes, %zu lines, plan %zu bytes, %zu lines "
+	    "of %d bytes\n\n",
+	    sizeof(struct utouch_softc),
+	    howmany(sizeof(struct utouch_softc), CACHE_LINE_SIZE),
+	    sizeof(struct utouch_plan),
+	    howmany(sizeof(struct utouch_plan), CACHE_LINE_SIZE),
+	    CACHE_LINE_SIZE);
+
+	for (i = 0; i < nitems(layout_refs); i++) {
+		lr = &layout_refs[i];
+		printf("%-24s %5zu %4zu  %s line", lr->lr_name, lr->lr_off,
+		    lr->lr_size, lr->lr_kind == LAYOUT_PLAN ? "plan " : "softc");
+		for (l = lr->lr_off / CACHE_LINE_SIZE;
+		    l <= (lr->lr_off + lr->lr_size - 1) / CACHE_LINE_SIZE;
+		    l++) {
+			printf(" %zu", l);
+			if (l >= LAYOUT_LINES_MAX)
+				errx(1, "line %zu past LAYOUT_LINES_MAX", l);
+			lines[lr->lr_kind][l] = 1;
+		}
+		printf("\n");
+	}
+
+	/* A softc line holding both kinds is counted as decode state */
+	printf("\nlines touched per report:");
+	total = 0;
+	for (k = 0; k < LAYOUT_NKINDS; k++) {
+		n = 0;
+		for (l = 0; l < LAYOUT_LINES_MAX; l++)
+			if (lines[k][l] && (k != LAYOUT_STATS ||
+			    !lines[LAYOUT_DECODE][l]))
+				n++;
+		printf(" %s %u,", layout_kinds[k], n);
+		total += n;
+	}
+	printf(" total %u\n", total);
+
+#ifdef LAYOUT_MEASURE
+	layout_measure(runs);
+#endif
+
+	return (0);
+}
@@ -0,0 +1,115 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Userspace stand-in for the auto-extending sbuf(9) the layout printer
+ * writes to.
+ */
+
+#include <sys/param.h>
+#include <sys/sbuf.h>
+
+#include <err.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct sbuf {
+	char	*s_buf;
+	size_t	s_len;
+	size_t	s_size;
+};
+
+struct sbuf *
+sbuf_new_auto(void)
+{
+	struct sbuf *s;
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		err(1, "calloc");
+	s->s_size = 256;
+	s->s_buf = malloc(s->s_size);
+	if (s->s_buf == NULL)
+		err(1, "malloc");
+	s->s_buf[0] = '\0';
+	return (s);
+}
+
+int
+sbuf_printf(struct sbuf *s, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(s->s_buf + s->s_len, s->s_size - s->s_len, fmt,
+		    ap);
+		va_end(ap);
+		if (n < 0)
+			return (-1);
+		if (s->s_len + n < s->s_size)
+			break;
+		s->s_size = 2 * (s->s_len + n + 1);
+		s->s_buf = realloc(s->s_buf, s->s_size);
+		if (s->s_buf == NULL)
+			err(1, "realloc");
+	}
+	s->s_len += n;
+	return (0);
+}
+
+int
+sbuf_finish(struct sbuf *s)
+{
+
+	return (0);
+}
+
+char *
+sbuf_data(struct sbuf *s)
+{
+
+	return (s->s_buf);
+}
+
+ssize_t
+sbuf_len(struct sbuf *s)
+{
+
+	return (s->s_len);
+}
+
+void
+sbuf_delete(struct sbuf *s)
+{
+
+	free(s->s_buf);
+	free(s);
+}
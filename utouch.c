@@ -27,17 +27,32 @@
  * $FreeBSD$
  */
 
+/*
+ * USB transport: probe and attach on uhub, the interrupt transfer and
+ * its power management.  Report decoding lives in utouch_core.c.
+ */
+
 #include <sys/param.h>
 #include <sys/bus.h>
+#include <sys/callout.h>
 #include <sys/conf.h>
+#include <sys/endian.h>
+#include <sys/eventhandler.h>
+#include <sys/hash.h>
 #include <sys/kernel.h>
 #include <sys/lock.h>
 #include <sys/malloc.h>
 #include <sys/module.h>
 #include <sys/mutex.h>
+#include <sys/sdt.h>
+#include <sys/selinfo.h>
 #include <sys/stddef.h>
 #include <sys/sysctl.h>
 #include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/time.h>
+
+#include <vm/vm.h>
 
 #if __FreeBSD_version >= 1300134
 #include <dev/hid/hid.h>
@@ -49,6 +64,9 @@
 #include <dev/usb/usbhid.h>
 #include "usbdevs.h"
 
+#ifdef UTOUCH_NO_DEBUG
+#undef USB_DEBUG
+#endif
 #define	USB_DEBUG_VAR utouch_debug
 #include <dev/usb/usb_debug.h>
 
@@ -57,76 +75,125 @@
 #include <dev/evdev/input.h>
 #include <dev/evdev/evdev.h>
 
-static int utouch_debug = 0;
-static SYSCTL_NODE(_hw_usb, OID_AUTO, utouch, CTLFLAG_RW | CTLFLAG_MPSAFE, 0,
-    "USB touch");
-SYSCTL_INT(_hw_usb_utouch, OID_AUTO, debug, CTLFLAG_RWTUN, &utouch_debug, 0,
-    "Debug level");
+#include "utouch.h"
+
+/*
+ * DTrace probes of the interrupt path:
+ *   utouch:usb:intr:truncated	softc, received length
+ *   utouch:usb:intr:backoff	softc, USB error, resubmit delay in ms
+ */
+SDT_PROVIDER_DECLARE(utouch);
+SDT_PROBE_DEFINE2(utouch, usb, intr, truncated, "struct utouch_usb_softc *",
+    "int");
+SDT_PROBE_DEFINE3(utouch, usb, intr, backoff, "struct utouch_usb_softc *",
+    "int", "int");
+
+static int utouch_autosuspend = 1;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, autosuspend, CTLFLAG_RWTUN,
+    &utouch_autosuspend, 0,
+    "Let the device suspend while no evdev client has it open");
+static int utouch_async_attach = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, async_attach, CTLFLAG_RWTUN,
+    &utouch_async_attach, 0,
+    "Finish attach (descriptor fetch, evdev registration) from a taskqueue");
 
 enum {
 	UTOUCH_INTR_DT,
 	UTOUCH_N_TRANSFER,
 };
 
-struct utouch_absinfo {
-	int32_t min;
-	int32_t max;
-	int32_t res;
+/*
+ * Interfaces that have already been probed and found not to carry an
+ * absolute pointer.  Probe runs again for every unattached interface each
+ * time a USB driver is loaded, so remember them to avoid repeating the
+ * report descriptor fetch.
+ *
+ * Entries are for one device instance, so that a device re-enumerating
+ * with the same IDs, e.g. after a mode switch, is probed again.  The
+ * configuration descriptor hash catches a changed descriptor set on a
+ * reused usb_device structure and address.
+ */
+struct utouch_nomatch
+{
+	struct usb_device *un_udev;
+	uint32_t un_cdhash;	/* configuration descriptor hash */
+	uint16_t un_vendor;
+	uint16_t un_product;
+	uint16_t un_release;
+	uint8_t	un_port;
+	uint8_t	un_index;	/* USB device index on the bus */
+	uint8_t	un_config;
+	uint8_t	un_iface;
+	uint8_t	un_valid;
 };
 
-struct utouch_softc
+#define	UTOUCH_NOMATCH_MAX	16
+
+static struct utouch_nomatch utouch_nomatch[UTOUCH_NOMATCH_MAX];
+static u_int utouch_nomatch_next;
+static struct mtx utouch_nomatch_mtx;
+MTX_SYSINIT(utouch_nomatch, &utouch_nomatch_mtx, "utouch nomatch", MTX_DEF);
+
+struct utouch_usb_softc
 {
-	device_t sc_dev;
-	struct evdev_dev *sc_evdev;
-	struct mtx sc_mtx;
-	struct usb_xfer *sc_xfer[UTOUCH_N_TRANSFER];
-	struct hid_location sc_loc_x;
-	struct hid_location sc_loc_y;
-	struct hid_location sc_loc_z;
-#define	UTOUCH_BUTTON_MAX	8
-	struct hid_location sc_loc_btn[UTOUCH_BUTTON_MAX];
-	struct utouch_absinfo sc_ai_x;
-	struct utouch_absinfo sc_ai_y;
-	uint8_t	sc_iid_x;
-	uint8_t	sc_iid_y;
-	uint8_t	sc_iid_z;
-	uint8_t	sc_iid_btn[UTOUCH_BUTTON_MAX];
-	uint8_t	sc_nbuttons;
-	uint32_t sc_flags;
-#define	UTOUCH_FLAG_X_AXIS	0x0001
-#define	UTOUCH_FLAG_Y_AXIS	0x0002
-#define	UTOUCH_FLAG_Z_AXIS	0x0004
-#define	UTOUCH_FLAG_OPENED	0x0008
-
-	uint8_t	sc_temp[64];
+	struct utouch_softc usc_core;	/* must be first */
+	struct usb_device *usc_udev;
+	struct mtx usc_mtx;
+	struct usb_xfer *usc_xfer[UTOUCH_N_TRANSFER];
+	struct timeout_task usc_attach_task;
+	u_int	usc_attach_tries;
+	bool	usc_releasing;	/* detaching from the attach task */
+	struct callout usc_callout;
+	uint8_t	usc_iface_index;
+	bool	usc_resuming;	/* waiting for the first report */
+	bool	usc_suspended;	/* suspended, transfer stopped */
+	bool	usc_waking;	/* waiting for the first report after it */
+	bool	usc_sleeping;	/* the system is suspending or suspended */
+	eventhandler_tag usc_suspend_tag;
+	eventhandler_tag usc_resume_tag;
+
+	u_int	usc_consec_errors;
+	uint64_t usc_errors;
+	uint64_t usc_backoffs;
+
+	sbintime_t usc_open_time;
+	uint64_t usc_open_lat;
+	uint64_t usc_open_lat_max;
+
+	sbintime_t usc_resume_time;
+	uint64_t usc_resume_lat;
+	uint64_t usc_resume_lat_max;
+	uint64_t usc_resumes;
+	uint64_t usc_selective_resumes;
 };
 
+/*
+ * Deferred attach retries of the report descriptor fetch, the n-th after
+ * n seconds, before the interface is left to other drivers.
+ */
+#define	UTOUCH_ATTACH_TRIES	3
+
+/* Resubmit delay bounds for repeated interrupt transfer errors */
+#define	UTOUCH_BACKOFF_MIN_MS	1
+#define	UTOUCH_BACKOFF_MAX_MS	1000
+
 static usb_callback_t utouch_intr_callback;
+static void utouch_backoff_timeout(void *);
+static void utouch_usb_start(struct utouch_softc *);
+static void utouch_usb_stop(struct utouch_softc *);
 
 static device_probe_t utouch_probe;
 static device_attach_t utouch_attach;
 static device_detach_t utouch_detach;
+static device_suspend_t utouch_suspend;
+static device_resume_t utouch_resume;
+static void utouch_power_suspend(void *);
+static void utouch_power_resume(void *);
 
-static int utouch_hid_test(const void *, uint16_t);
-static void utouch_hid_parse(struct utouch_softc *, const void *, uint16_t);
-
-#if __FreeBSD_version >= 1200077
-static evdev_open_t utouch_ev_open;
-static evdev_close_t utouch_ev_close;
-#else
-static evdev_open_t utouch_ev_open_11;
-static evdev_close_t utouch_ev_close_11;
-#endif
-
-static const struct evdev_methods utouch_evdev_methods = {
-#if __FreeBSD_version >= 1200077
-	.ev_open = &utouch_ev_open,
-	.ev_close = &utouch_ev_close,
-#else
-	.ev_open = &utouch_ev_open_11,
-	.ev_close = &utouch_ev_close_11,
-#endif
-};
+static task_fn_t utouch_attach_task;
+static int utouch_attach_evdev(struct utouch_usb_softc *);
+static bool utouch_nomatch_test(const struct usb_attach_arg *);
+static void utouch_nomatch_add(const struct usb_attach_arg *);
 
 static const struct usb_config utouch_config[UTOUCH_N_TRANSFER] = {
 
@@ -154,15 +221,41 @@ utouch_probe(device_t dev)
 	if (uaa->info.bInterfaceClass != UICLASS_HID)
 		return (ENXIO);
 
+	/*
+	 * Reject what can be rejected without touching the device: boot
+	 * keyboards, devices quirked away from HID or mouse drivers and
+	 * interfaces which have already failed the descriptor test.
+	 */
+	if (uaa->info.bInterfaceSubClass == UISUBCLASS_BOOT &&
+	    uaa->info.bInterfaceProtocol == UIPROTO_BOOT_KEYBOARD)
+		return (ENXIO);
+
+	if (usb_test_quirk(uaa, UQ_HID_IGNORE) ||
+	    usb_test_quirk(uaa, UQ_UMS_IGNORE))
+		return (ENXIO);
+
+	if (utouch_nomatch_test(uaa))
+		return (ENXIO);
+
 	err = usbd_req_get_hid_desc(uaa->device, NULL,
 	    &d_ptr, &d_len, M_TEMP, uaa->info.bIfaceIndex);
 	if (err != USB_ERR_NORMAL_COMPLETION)
 		return (ENXIO);
 
-	if (utouch_hid_test(d_ptr, d_len))
+	switch (utouch_hid_test(d_ptr, d_len, -1)) {
+	case UTOUCH_TEST_MOUSE:
+	case UTOUCH_TEST_MOUSE | UTOUCH_TEST_TOUCH:
 		err = BUS_PROBE_DEFAULT;
-	else
+		break;
+	case UTOUCH_TEST_TOUCH:
+		/* Leave real multi-touch hardware to wmt(4) if present */
+		err = BUS_PROBE_GENERIC;
+		break;
+	default:
+		utouch_nomatch_add(uaa);
 		err = ENXIO;
+		break;
+	}
 
 	free(d_ptr, M_TEMP);
 	return (err);
@@ -172,69 +265,99 @@ static int
 utouch_attach(device_t dev)
 {
 	struct usb_attach_arg *uaa = device_get_ivars(dev);
-	struct utouch_softc *sc = device_get_softc(dev);
-	void *d_ptr = NULL;
-	uint16_t d_len;
-	int i, err;
+	struct utouch_usb_softc *usc = device_get_softc(dev);
+	struct utouch_softc *sc = &usc->usc_core;
+	int err;
 
 	device_set_usb_desc(dev);
-	sc->sc_dev = dev;
+	usc->usc_udev = uaa->device;
+	usc->usc_iface_index = uaa->info.bIfaceIndex;
+
+	mtx_init(&usc->usc_mtx, "utouch lock", NULL, MTX_DEF | MTX_RECURSE);
+	TIMEOUT_TASK_INIT(taskqueue_thread, &usc->usc_attach_task, 0,
+	    utouch_attach_task, usc);
+	callout_init_mtx(&usc->usc_callout, &usc->usc_mtx, 0);
+
+	/*
+	 * USB selective suspend calls the suspend and resume methods too,
+	 * tell system sleep apart by the events fired around it.
+	 */
+	usc->usc_suspend_tag = EVENTHANDLER_REGISTER(power_suspend,
+	    utouch_power_suspend, usc, EVENTHANDLER_PRI_ANY);
+	usc->usc_resume_tag = EVENTHANDLER_REGISTER(power_resume,
+	    utouch_power_resume, usc, EVENTHANDLER_PRI_ANY);
 
-	mtx_init(&sc->sc_mtx, "utouch lock", NULL, MTX_DEF | MTX_RECURSE);
+	sc->sc_dev = dev;
+	sc->sc_lock = &usc->usc_mtx;
+	sc->sc_bus = BUS_USB;
+	sc->sc_vendor = uaa->info.idVendor;
+	sc->sc_product = uaa->info.idProduct;
+	sc->sc_serial = usb_get_serial(uaa->device);
+	sc->sc_start = utouch_usb_start;
+	sc->sc_stop = utouch_usb_stop;
+
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "errors", CTLFLAG_RD, &usc->usc_errors, 0,
+	    "Interrupt transfer errors");
+	SYSCTL_ADD_UINT(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "consec_errors", CTLFLAG_RD, &usc->usc_consec_errors, 0,
+	    "Consecutive interrupt transfer errors");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "backoffs", CTLFLAG_RD, &usc->usc_backoffs, 0,
+	    "Delayed resubmits after repeated errors");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "open_latency_us", CTLFLAG_RD, &usc->usc_open_lat, 0,
+	    "Time from the last evdev open to the first report, us");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "open_latency_max_us", CTLFLAG_RD, &usc->usc_open_lat_max, 0,
+	    "Longest time from an evdev open to the first report, us");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "resumes", CTLFLAG_RD, &usc->usc_resumes, 0,
+	    "System resumes");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "selective_resumes", CTLFLAG_RD, &usc->usc_selective_resumes, 0,
+	    "Resumes from USB selective suspend");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "resume_latency_us", CTLFLAG_RD, &usc->usc_resume_lat, 0,
+	    "Time from the last system resume to the first report, us");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "resume_latency_max_us", CTLFLAG_RD, &usc->usc_resume_lat_max, 0,
+	    "Longest time from a system resume to the first report, us");
 
 	err = usbd_transfer_setup(uaa->device,
-	    &uaa->info.bIfaceIndex, sc->sc_xfer, utouch_config,
-	    UTOUCH_N_TRANSFER, sc, &sc->sc_mtx);
+	    &uaa->info.bIfaceIndex, usc->usc_xfer, utouch_config,
+	    UTOUCH_N_TRANSFER, usc, &usc->usc_mtx);
 	if (err != USB_ERR_NORMAL_COMPLETION)
 		goto detach;
 
-	err = usbd_req_get_hid_desc(uaa->device, NULL, &d_ptr,
-	    &d_len, M_TEMP, uaa->info.bIfaceIndex);
-	if (err != USB_ERR_NORMAL_COMPLETION)
+	if (utouch_core_init(sc) != 0)
 		goto detach;
 
-	utouch_hid_parse(sc, d_ptr, d_len);
-	free(d_ptr, M_TEMP);
-
-	sc->sc_evdev = evdev_alloc();
-	evdev_set_name(sc->sc_evdev, device_get_desc(dev));
-	evdev_set_phys(sc->sc_evdev, device_get_nameunit(dev));
-	evdev_set_id(sc->sc_evdev, BUS_USB, uaa->info.idVendor,
-	    uaa->info.idProduct, 0);
-	evdev_set_serial(sc->sc_evdev, usb_get_serial(uaa->device));
-	evdev_set_methods(sc->sc_evdev, sc, &utouch_evdev_methods);
-	evdev_support_prop(sc->sc_evdev, INPUT_PROP_DIRECT);
-	evdev_support_event(sc->sc_evdev, EV_SYN);
-	evdev_support_event(sc->sc_evdev, EV_ABS);
-	evdev_support_event(sc->sc_evdev, EV_REL);
-	evdev_support_event(sc->sc_evdev, EV_KEY);
-
-	/* Report absolute axes information */
-	if (sc->sc_flags & UTOUCH_FLAG_X_AXIS)
-#if __FreeBSD_version >= 1300134
-		evdev_support_abs(sc->sc_evdev, ABS_X, sc->sc_ai_x.min,
-		    sc->sc_ai_x.max, 0, 0, sc->sc_ai_x.res);
-#else
-		evdev_support_abs(sc->sc_evdev, ABS_X, 0, sc->sc_ai_x.min,
-		    sc->sc_ai_x.max, 0, 0, sc->sc_ai_x.res);
-#endif
-	if (sc->sc_flags & UTOUCH_FLAG_Y_AXIS)
-#if __FreeBSD_version >= 1300134
-		evdev_support_abs(sc->sc_evdev, ABS_Y, sc->sc_ai_y.min,
-		    sc->sc_ai_y.max, 0, 0, sc->sc_ai_y.res);
-#else
-		evdev_support_abs(sc->sc_evdev, ABS_Y, 0, sc->sc_ai_y.min,
-		    sc->sc_ai_y.max, 0, 0, sc->sc_ai_y.res);
-#endif
-
-	if (sc->sc_flags & UTOUCH_FLAG_Z_AXIS)
-		evdev_support_rel(sc->sc_evdev, REL_WHEEL);
-
-	for (i = 0; i < sc->sc_nbuttons; i++)
-		evdev_support_key(sc->sc_evdev, BTN_MOUSE + i);
+	/* Nothing has the device open yet */
+	if (utouch_autosuspend)
+		usbd_set_power_mode(usc->usc_udev, USB_POWER_MODE_SAVE);
+
+	/*
+	 * Claim the device right away and leave the report descriptor
+	 * fetch and evdev registration to a task, so that they do not hold
+	 * up the rest of the bus enumeration.
+	 */
+	if (utouch_async_attach) {
+		taskqueue_enqueue_timeout(taskqueue_thread,
+		    &usc->usc_attach_task, 0);
+		return (0);
+	}
 
-	err = evdev_register_mtx(sc->sc_evdev, &sc->sc_mtx);
-	if (err)
+	if (utouch_attach_evdev(usc) != 0)
 		goto detach;
 
 	return (0);
@@ -244,66 +367,130 @@ detach:
 	return (ENXIO);
 }
 
+/*
+ * Retry a failed descriptor fetch a few times.  If attach still fails,
+ * detach and remember the interface as not ours, then probe it again so
+ * that another driver can claim it instead of leaving it dead until the
+ * device is plugged again.
+ */
+static void
+utouch_attach_task(void *arg, int pending)
+{
+	struct utouch_usb_softc *usc = arg;
+	device_t dev = usc->usc_core.sc_dev;
+	int err;
+
+	err = utouch_attach_evdev(usc);
+	if (err == 0)
+		return;
+	if (err == EAGAIN && ++usc->usc_attach_tries < UTOUCH_ATTACH_TRIES) {
+		taskqueue_enqueue_timeout(taskqueue_thread,
+		    &usc->usc_attach_task, usc->usc_attach_tries * hz);
+		return;
+	}
+
+	/* Detach may be running already and waiting for this task */
+	if (!mtx_trylock(&Giant)) {
+		taskqueue_enqueue_timeout(taskqueue_thread,
+		    &usc->usc_attach_task, hz / 10);
+		return;
+	}
+	device_printf(dev, "deferred attach failed, releasing interface\n");
+	utouch_nomatch_add(device_get_ivars(dev));
+	usc->usc_releasing = true;
+	if (device_detach(dev) == 0)
+		device_probe_and_attach(dev);
+	mtx_unlock(&Giant);
+}
+
 static int
-utouch_detach(device_t dev)
+utouch_attach_evdev(struct utouch_usb_softc *usc)
 {
-	struct utouch_softc *sc = device_get_softc(dev);
+	void *d_ptr = NULL;
+	uint16_t d_len;
+	int err;
+
+	err = usbd_req_get_hid_desc(usc->usc_udev, NULL, &d_ptr,
+	    &d_len, M_TEMP, usc->usc_iface_index);
+	if (err != USB_ERR_NORMAL_COMPLETION)
+		return (EAGAIN);
+
+	err = utouch_core_attach(&usc->usc_core, d_ptr, d_len, -1);
+	free(d_ptr, M_TEMP);
 
-	evdev_free(sc->sc_evdev);
-	usbd_transfer_unsetup(sc->sc_xfer, UTOUCH_N_TRANSFER);
-	mtx_destroy(&sc->sc_mtx);
+	return (err);
+}
+
+static int
+utouch_detach(device_t dev)
+{
+	struct utouch_usb_softc *usc = device_get_softc(dev);
+
+	/*
+	 * Wait for, or prevent, a deferred attach still in flight, unless
+	 * it is that task which detaches.
+	 */
+	if (!usc->usc_releasing &&
+	    taskqueue_cancel_timeout(taskqueue_thread, &usc->usc_attach_task,
+	    NULL) != 0)
+		taskqueue_drain_timeout(taskqueue_thread,
+		    &usc->usc_attach_task);
+
+	if (usc->usc_suspend_tag != NULL)
+		EVENTHANDLER_DEREGISTER(power_suspend, usc->usc_suspend_tag);
+	if (usc->usc_resume_tag != NULL)
+		EVENTHANDLER_DEREGISTER(power_resume, usc->usc_resume_tag);
+	utouch_core_detach(&usc->usc_core);
+	callout_drain(&usc->usc_callout);
+	usbd_transfer_unsetup(usc->usc_xfer, UTOUCH_N_TRANSFER);
+	utouch_core_free(&usc->usc_core);
+	mtx_destroy(&usc->usc_mtx);
 	return (0);
 }
 
 static void
 utouch_intr_callback(struct usb_xfer *xfer, usb_error_t error)
 {
-	struct utouch_softc *sc = usbd_xfer_softc(xfer);
+	struct utouch_usb_softc *usc = usbd_xfer_softc(xfer);
+	struct utouch_softc *sc = &usc->usc_core;
 	struct usb_page_cache *pc;
-	uint8_t *buf = sc->sc_temp;
-	uint8_t id;
-	int len, i;
+	sbintime_t now;
+	int len, delay;
 
 	usbd_xfer_status(xfer, &len, NULL, NULL, NULL);
 
 	switch (USB_GET_STATE(xfer)) {
 	case USB_ST_TRANSFERRED:
-		if (len > (int)sizeof(sc->sc_temp)) {
-			DPRINTFN(6, "truncating large packet to %zu bytes\n",
-			    sizeof(sc->sc_temp));
-			len = sizeof(sc->sc_temp);
+		/*
+		 * Take the timestamp as early as possible, before the time
+		 * spent decoding and pushing the events to evdev.
+		 */
+		now = sbinuptime();
+		usc->usc_consec_errors = 0;
+		if (usc->usc_resuming) {
+			usc->usc_resuming = false;
+			usc->usc_open_lat = sbttous(now - usc->usc_open_time);
+			if (usc->usc_open_lat > usc->usc_open_lat_max)
+				usc->usc_open_lat_max = usc->usc_open_lat;
+		}
+		if (usc->usc_waking) {
+			usc->usc_waking = false;
+			usc->usc_resume_lat =
+			    sbttous(now - usc->usc_resume_time);
+			if (usc->usc_resume_lat > usc->usc_resume_lat_max)
+				usc->usc_resume_lat_max = usc->usc_resume_lat;
+		}
+		if (len > UTOUCH_REPORT_MAX) {
+			SDT_PROBE2(utouch, usb, intr, truncated, usc, len);
+			len = UTOUCH_REPORT_MAX;
 		}
 		if (len == 0)
 			goto tr_setup;
 
 		pc = usbd_xfer_get_frame(xfer, 0);
-		usbd_copy_out(pc, 0, buf, len);
-
-		id = 0;
-		if (sc->sc_iid_x > 0 || sc->sc_iid_y > 0) {
-			id = *buf;
-			len--;
-			buf++;
-                }
-
-		if (sc->sc_flags & UTOUCH_FLAG_X_AXIS && id == sc->sc_iid_x)
-			evdev_push_abs(sc->sc_evdev, ABS_X,
-			    hid_get_data(buf, len, &sc->sc_loc_x));
-
-		if (sc->sc_flags & UTOUCH_FLAG_Y_AXIS && id == sc->sc_iid_y)
-			evdev_push_abs(sc->sc_evdev, ABS_Y,
-			    hid_get_data(buf, len, &sc->sc_loc_y));
-
-		if (sc->sc_flags & UTOUCH_FLAG_Z_AXIS && id == sc->sc_iid_z)
-			evdev_push_rel(sc->sc_evdev, REL_WHEEL,
-			    hid_get_data(buf, len, &sc->sc_loc_z));
+		usbd_copy_out(pc, 0, sc->sc_temp, len);
 
-		for (i = 0; i < sc->sc_nbuttons; i++)
-			if (id == sc->sc_iid_btn[i])
-				evdev_push_key(sc->sc_evdev, BTN_MOUSE + i,
-				    hid_get_data(buf, len, &sc->sc_loc_btn[i]));
-
-		evdev_sync(sc->sc_evdev);
+		utouch_core_input(sc, len, now);
 
 	case USB_ST_SETUP:
 tr_setup:
@@ -312,197 +499,207 @@ tr_setup:
 		break;
 	default:
 		if (error != USB_ERR_CANCELLED) {
+			usc->usc_errors++;
 			/* try clear stall first */
 			usbd_xfer_set_stall(xfer);
-			goto tr_setup;
+			if (usc->usc_consec_errors++ == 0)
+				goto tr_setup;
+			/*
+			 * The error persists, e.g. while the VM is paused or
+			 * the virtual controller is wedged.  Resubmit from a
+			 * callout with exponentially growing delay rather
+			 * than spinning on the error.
+			 */
+			usc->usc_backoffs++;
+			delay = UTOUCH_BACKOFF_MIN_MS <<
+			    MIN(usc->usc_consec_errors - 2, 16);
+			if (delay > UTOUCH_BACKOFF_MAX_MS)
+				delay = UTOUCH_BACKOFF_MAX_MS;
+			SDT_PROBE3(utouch, usb, intr, backoff, usc, error,
+			    delay);
+			callout_reset_sbt(&usc->usc_callout, delay * SBT_1MS, 0,
+			    utouch_backoff_timeout, usc, 0);
 		}
 		break;
 	}
 }
 
 static void
-utouch_ev_close_11(struct evdev_dev *evdev, void *ev_softc)
+utouch_backoff_timeout(void *arg)
 {
-	struct utouch_softc *sc = ev_softc;
+	struct utouch_usb_softc *usc = arg;
 
-	mtx_assert(&sc->sc_mtx, MA_OWNED);
-	usbd_transfer_stop(sc->sc_xfer[UTOUCH_INTR_DT]);
+	mtx_assert(&usc->usc_mtx, MA_OWNED);
+
+	if ((usc->usc_core.sc_flags & UTOUCH_FLAG_READERS) &&
+	    !usc->usc_suspended)
+		usbd_transfer_start(usc->usc_xfer[UTOUCH_INTR_DT]);
 }
 
-static int
-utouch_ev_open_11(struct evdev_dev *evdev, void *ev_softc)
+/*
+ * The interrupt transfer runs while there is at least one consumer of the
+ * reports, an evdev client or the raw device.
+ */
+static void
+utouch_usb_start(struct utouch_softc *sc)
+{
+	struct utouch_usb_softc *usc = (struct utouch_usb_softc *)sc;
+
+	mtx_assert(&usc->usc_mtx, MA_OWNED);
+	usbd_set_power_mode(usc->usc_udev, USB_POWER_MODE_ON);
+	usc->usc_open_time = sbinuptime();
+	usc->usc_resuming = true;
+	/* Opened while suspended, utouch_resume() starts the transfer */
+	if (!usc->usc_suspended)
+		usbd_transfer_start(usc->usc_xfer[UTOUCH_INTR_DT]);
+}
+
+static void
+utouch_usb_stop(struct utouch_softc *sc)
 {
-	struct utouch_softc *sc = ev_softc;
+	struct utouch_usb_softc *usc = (struct utouch_usb_softc *)sc;
 
-        mtx_assert(&sc->sc_mtx, MA_OWNED);
-	usbd_transfer_start(sc->sc_xfer[UTOUCH_INTR_DT]);
+	mtx_assert(&usc->usc_mtx, MA_OWNED);
+	usc->usc_resuming = false;
+	usc->usc_waking = false;
+	callout_stop(&usc->usc_callout);
+	usbd_transfer_stop(usc->usc_xfer[UTOUCH_INTR_DT]);
 
-        return (0);
+	/* Nobody listens, let the device and the controller idle */
+	if (utouch_autosuspend)
+		usbd_set_power_mode(usc->usc_udev, USB_POWER_MODE_SAVE);
 }
 
-#if __FreeBSD_version >= 1200077
-static int
-utouch_ev_close(struct evdev_dev *evdev)
+static void
+utouch_power_suspend(void *arg)
 {
-	struct utouch_softc *sc = evdev_get_softc(evdev);
+	struct utouch_usb_softc *usc = arg;
 
-	utouch_ev_close_11(evdev, sc);
+	mtx_lock(&usc->usc_mtx);
+	usc->usc_sleeping = true;
+	mtx_unlock(&usc->usc_mtx);
+}
 
-	return (0);
+/* After the devices have been resumed, or the suspend failed */
+static void
+utouch_power_resume(void *arg)
+{
+	struct utouch_usb_softc *usc = arg;
+
+	mtx_lock(&usc->usc_mtx);
+	usc->usc_sleeping = false;
+	mtx_unlock(&usc->usc_mtx);
 }
 
+/*
+ * Keep the plan, the evdev devices and the transfer setup over a system
+ * suspend, only the interrupt pipe is stopped and restarted.  The same
+ * goes for USB selective suspend while the device is not open.
+ */
 static int
-utouch_ev_open(struct evdev_dev *evdev)
+utouch_suspend(device_t dev)
 {
-	struct utouch_softc *sc = evdev_get_softc(evdev);
+	struct utouch_usb_softc *usc = device_get_softc(dev);
+
+	mtx_lock(&usc->usc_mtx);
+	usc->usc_suspended = true;
+	usc->usc_waking = false;
+	callout_stop(&usc->usc_callout);
+	usbd_transfer_stop(usc->usc_xfer[UTOUCH_INTR_DT]);
+	mtx_unlock(&usc->usc_mtx);
 
-	return (utouch_ev_open_11(evdev, sc));
+	return (0);
 }
-#endif
 
 static int
-utouch_hid_test(const void *d_ptr, uint16_t d_len)
+utouch_resume(device_t dev)
 {
-	struct hid_data *hd;
-	struct hid_item hi;
-	int mdepth;
-	int found;
+	struct utouch_usb_softc *usc = device_get_softc(dev);
 
-	hd = hid_start_parse(d_ptr, d_len, 1 << hid_input);
-	if (hd == NULL)
-		return (0);
-
-	mdepth = 0;
-	found = 0;
-
-	while (hid_get_item(hd, &hi)) {
-		switch (hi.kind) {
-		case hid_collection:
-			if (mdepth != 0)
-				mdepth++;
-			else if (hi.collection == 1 &&
-			     hi.usage ==
-			      HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_MOUSE))
-				mdepth++;
-			break;
-		case hid_endcollection:
-			if (mdepth != 0)
-				mdepth--;
-			break;
-		case hid_input:
-			if (mdepth == 0)
-				break;
-			if (hi.usage ==
-			     HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_X) &&
-			    (hi.flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE)
-				found++;
-			if (hi.usage ==
-			     HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_Y) &&
-			    (hi.flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE)
-				found++;
-			break;
-		default:
-			break;
+	mtx_lock(&usc->usc_mtx);
+	usc->usc_suspended = false;
+	if (usc->usc_sleeping)
+		usc->usc_resumes++;
+	else
+		usc->usc_selective_resumes++;
+	usc->usc_consec_errors = 0;
+	if (usc->usc_core.sc_flags & UTOUCH_FLAG_READERS) {
+		usbd_set_power_mode(usc->usc_udev, USB_POWER_MODE_ON);
+		/* An open waking the device is timed as open latency */
+		if (usc->usc_sleeping) {
+			usc->usc_resume_time = sbinuptime();
+			usc->usc_waking = true;
 		}
+		usbd_transfer_start(usc->usc_xfer[UTOUCH_INTR_DT]);
 	}
-	hid_end_parse(hd);
-	return (found);
+	usc->usc_sleeping = false;
+	mtx_unlock(&usc->usc_mtx);
+
+	return (0);
 }
 
-static void
-utouch_hid_parse(struct utouch_softc *sc, const void *buf, uint16_t len)
+static uint32_t
+utouch_nomatch_cdhash(const struct usb_attach_arg *uaa)
 {
-	struct hid_data *hd;
-	struct hid_item hi;
-	int mdepth;
-	uint32_t flags;
-	uint8_t i;
-
-	hd = hid_start_parse(buf, len, 1 << hid_input);
-	if (hd == NULL)
-		return;
+	struct usb_config_descriptor *cd;
 
-	mdepth = 0;
-
-	while (hid_get_item(hd, &hi)) {
-		switch (hi.kind) {
-		case hid_collection:
-			if (mdepth != 0)
-				mdepth++;
-			else if (hi.collection == 1 &&
-			     hi.usage ==
-			      HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_MOUSE))
-				mdepth++;
-			break;
-		case hid_endcollection:
-			if (mdepth != 0)
-				mdepth--;
-			break;
-		case hid_input:
-			if (mdepth == 0)
-				break;
-			if (hi.usage ==
-			     HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_X) &&
-			    (hi.flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE) {
-				sc->sc_flags |= UTOUCH_FLAG_X_AXIS;
-				sc->sc_loc_x = hi.loc;
-				sc->sc_iid_x = hi.report_ID;
-				sc->sc_ai_x = (struct utouch_absinfo) {
-					.max = hi.logical_maximum,
-					.min = hi.logical_minimum,
-					.res = hid_item_resolution(&hi),
-				};
-			}
-			if (hi.usage ==
-			     HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_Y) &&
-			    (hi.flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE) {
-				sc->sc_flags |= UTOUCH_FLAG_Y_AXIS;
-				sc->sc_loc_y = hi.loc;
-				sc->sc_iid_y = hi.report_ID;
-				sc->sc_ai_y = (struct utouch_absinfo) {
-					.max = hi.logical_maximum,
-					.min = hi.logical_minimum,
-					.res = hid_item_resolution(&hi),
-				};
-			}
-			break;
-		default:
-			break;
-		}
-	}
-	hid_end_parse(hd);
-
-	/* Try the wheel first as the Z activator since it's tradition. */
-	if (hid_locate(buf, len,
-	    HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_WHEEL),
-	    hid_input, 0, &sc->sc_loc_z, &flags, &sc->sc_iid_z) ||
-	    hid_locate(buf, len,
-	    HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_TWHEEL),
-	    hid_input, 0, &sc->sc_loc_z, &flags, &sc->sc_iid_z)) {
-		if (flags & HIO_VARIABLE)
-			sc->sc_flags |= UTOUCH_FLAG_Z_AXIS;
-	}
+	cd = usbd_get_config_descriptor(uaa->device);
+	if (cd == NULL)
+		return (0);
+	return (hash32_buf(cd, UGETW(cd->wTotalLength), HASHINIT));
+}
 
-	/* figure out the number of buttons */
-	for (i = 0; i < UTOUCH_BUTTON_MAX; i++) {
-		if (!hid_locate(buf, len, HID_USAGE2(HUP_BUTTON, (i + 1)),
-		    hid_input, 0, &sc->sc_loc_btn[i], NULL,
-		    &sc->sc_iid_btn[i])) {
+static bool
+utouch_nomatch_test(const struct usb_attach_arg *uaa)
+{
+	struct utouch_nomatch *un;
+	uint32_t cdhash;
+	bool found = false;
+
+	cdhash = utouch_nomatch_cdhash(uaa);
+	mtx_lock(&utouch_nomatch_mtx);
+	for (un = utouch_nomatch; un < utouch_nomatch + UTOUCH_NOMATCH_MAX;
+	    un++) {
+		if (un->un_valid &&
+		    un->un_udev == uaa->device &&
+		    un->un_port == uaa->port &&
+		    un->un_index == usbd_get_device_index(uaa->device) &&
+		    un->un_cdhash == cdhash &&
+		    un->un_vendor == uaa->info.idVendor &&
+		    un->un_product == uaa->info.idProduct &&
+		    un->un_release == uaa->info.bcdDevice &&
+		    un->un_config == uaa->info.bConfigIndex &&
+		    un->un_iface == uaa->info.bIfaceIndex) {
+			found = true;
 			break;
 		}
 	}
+	mtx_unlock(&utouch_nomatch_mtx);
 
-	sc->sc_nbuttons = i;
-
-	if (sc->sc_flags == 0)
-		return;
+	return (found);
+}
 
-	/* announce information about the mouse */
-	device_printf(sc->sc_dev, "%d buttons and [%s%s%s] axes\n",
-	    (sc->sc_nbuttons),
-	    (sc->sc_flags & UTOUCH_FLAG_X_AXIS) ? "X" : "",
-	    (sc->sc_flags & UTOUCH_FLAG_Y_AXIS) ? "Y" : "",
-	    (sc->sc_flags & UTOUCH_FLAG_Z_AXIS) ? "Z" : "");
+static void
+utouch_nomatch_add(const struct usb_attach_arg *uaa)
+{
+	uint32_t cdhash;
+
+	cdhash = utouch_nomatch_cdhash(uaa);
+	mtx_lock(&utouch_nomatch_mtx);
+	utouch_nomatch[utouch_nomatch_next] = (struct utouch_nomatch) {
+		.un_udev = uaa->device,
+		.un_cdhash = cdhash,
+		.un_port = uaa->port,
+		.un_index = usbd_get_device_index(uaa->device),
+		.un_vendor = uaa->info.idVendor,
+		.un_product = uaa->info.idProduct,
+		.un_release = uaa->info.bcdDevice,
+		.un_config = uaa->info.bConfigIndex,
+		.un_iface = uaa->info.bIfaceIndex,
+		.un_valid = 1,
+	};
+	utouch_nomatch_next = (utouch_nomatch_next + 1) % UTOUCH_NOMATCH_MAX;
+	mtx_unlock(&utouch_nomatch_mtx);
 }
 
 static const STRUCT_USB_HOST_ID utouch_devs[] = {
@@ -515,6 +712,8 @@ static device_method_t utouch_methods[] = {
 	DEVMETHOD(device_probe, utouch_probe),
 	DEVMETHOD(device_attach, utouch_attach),
 	DEVMETHOD(device_detach, utouch_detach),
+	DEVMETHOD(device_suspend, utouch_suspend),
+	DEVMETHOD(device_resume, utouch_resume),
 
 	DEVMETHOD_END
 };
@@ -522,15 +721,16 @@ static device_method_t utouch_methods[] = {
 static driver_t utouch_driver = {
 	.name = "utouch",
 	.methods = utouch_methods,
-	.size = sizeof(struct utouch_softc),
+	.size = sizeof(struct utouch_usb_softc),
 };
 
 #if __FreeBSD_version >= 1400058
-DRIVER_MODULE(utouch, uhub, utouch_driver, NULL, NULL);
+DRIVER_MODULE(utouch, uhub, utouch_driver, utouch_modevent, NULL);
 #else
 static devclass_t utouch_devclass;
 
-DRIVER_MODULE(utouch, uhub, utouch_driver, utouch_devclass, NULL, 0);
+DRIVER_MODULE(utouch, uhub, utouch_driver, utouch_devclass, utouch_modevent,
+    NULL);
 #endif
 MODULE_DEPEND(utouch, usb, 1, 1, 1);
 #if __FreeBSD_version >= 1300134
@@ -0,0 +1,452 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _UTOUCH_H_
+#define	_UTOUCH_H_
+
+/*
+ * Transport-neutral part of the driver: report descriptor analysis, report
+ * decoding, evdev and raw device.  The bus attachments (USB and, on 13+,
+ * hidbus) fetch the report descriptor, deliver interrupt reports through
+ * utouch_core_input() and start or stop them on request.
+ */
+
+SYSCTL_DECL(_hw_usb_utouch);
+#ifdef USB_DEBUG
+extern int utouch_debug;
+#endif
+
+struct utouch_absinfo {
+	int32_t min;
+	int32_t max;
+	int32_t res;
+};
+
+/*
+ * Compiled input field.  Extraction is a single unaligned 32-bit load
+ * followed by mask, shift and sign extension, which gives the same result
+ * as hid_get_data() on the location the field was compiled from, provided
+ * the bytes past the end of the report are zeroed.
+ */
+struct utouch_field
+{
+	uint16_t uf_type;	/* evdev event type */
+	uint16_t uf_code;	/* evdev event code */
+	uint8_t	uf_id;		/* report ID */
+	uint8_t	uf_off;		/* first byte of the field */
+	uint8_t	uf_shift;	/* bit offset inside the first byte */
+	uint8_t	uf_ext;		/* 32 - field size */
+	uint32_t uf_mask;	/* bytes hid_get_data() would read */
+	uint8_t	uf_flags;
+#define	UTOUCH_FIELD_UNSIGNED	0x01	/* zero-extend like hid_get_udata() */
+};
+
+static __inline int32_t
+utouch_field_get(const uint8_t *buf, const struct utouch_field *uf)
+{
+	uint32_t data;
+
+	data = (le32dec(buf + uf->uf_off) & uf->uf_mask) >> uf->uf_shift;
+	return ((int32_t)(data << uf->uf_ext) >> uf->uf_ext);
+}
+
+static __inline int32_t
+utouch_field_value(const uint8_t *buf, const struct utouch_field *uf)
+{
+	uint32_t data;
+
+	if ((uf->uf_flags & UTOUCH_FIELD_UNSIGNED) == 0)
+		return (utouch_field_get(buf, uf));
+	data = (le32dec(buf + uf->uf_off) & uf->uf_mask) >> uf->uf_shift;
+	return ((data << uf->uf_ext) >> uf->uf_ext);
+}
+
+/* Multi-touch contact usages, in a contact collection */
+enum {
+	UTOUCH_MT_TIP,
+	UTOUCH_MT_ID,
+	UTOUCH_MT_X,
+	UTOUCH_MT_Y,
+	UTOUCH_MT_NUSAGES,
+};
+
+#define	UTOUCH_MT_MAX		10	/* contacts tracked at once */
+#define	UTOUCH_MT_TID_MAX	0xffff	/* tracking IDs wrap at this */
+
+/* Largest report handled, bytes past it are treated as zeroes */
+#define	UTOUCH_REPORT_MAX	64
+#define	UTOUCH_BUFSIZE	(UTOUCH_REPORT_MAX + sizeof(uint32_t))
+
+/*
+ * Absolute pointer top-level collection, a tablet-like mouse or a
+ * touchscreen.  Every collection is decoded on its own and is exported
+ * as a separate evdev device.
+ *
+ * What the interrupt path reads comes first, so that decoding a mouse
+ * report touches only the leading cache lines.  The HID locations and
+ * axis ranges after it are used at attach and by the verifier only.
+ */
+struct utouch_coll
+{
+	uint32_t uc_flags;
+#define	UTOUCH_FLAG_X_AXIS	0x0001
+#define	UTOUCH_FLAG_Y_AXIS	0x0002
+#define	UTOUCH_FLAG_Z_AXIS	0x0004
+#define	UTOUCH_FLAG_MT		0x0008
+#define	UTOUCH_FLAG_MT_COUNT	0x0010
+#define	UTOUCH_FLAG_REL_X	0x0020
+#define	UTOUCH_FLAG_REL_Y	0x0040
+#define	UTOUCH_FLAG_REL_Z	0x0080
+#define	UTOUCH_FLAG_MOUSE	\
+	(UTOUCH_FLAG_X_AXIS | UTOUCH_FLAG_Y_AXIS | UTOUCH_FLAG_Z_AXIS)
+	uint8_t	uc_nfields;
+	uint8_t	uc_iid_mt;
+	uint8_t	uc_mt_ncontacts;
+	uint8_t	uc_mt_nslots;
+
+#define	UTOUCH_BUTTON_MAX	8
+#define	UTOUCH_FIELD_MAX	(6 + 2 * UTOUCH_BUTTON_MAX)
+	struct utouch_field uc_fields[UTOUCH_FIELD_MAX];
+
+	/*
+	 * Touchscreen: uc_mt_ncontacts contact collections per report, each
+	 * decoded with uc_mt_fields, and up to uc_mt_nslots contacts per frame.
+	 */
+	struct utouch_field uc_mt_count;
+	struct utouch_field uc_mt_fields[UTOUCH_MT_MAX][UTOUCH_MT_NUSAGES];
+
+	/* Attach time state */
+	struct hid_location uc_loc_x;
+	struct hid_location uc_loc_y;
+	struct hid_location uc_loc_z;
+	struct hid_location uc_loc_btn[UTOUCH_BUTTON_MAX];
+	struct utouch_absinfo uc_ai_x;
+	struct utouch_absinfo uc_ai_y;
+	uint8_t	uc_iid_x;
+	uint8_t	uc_iid_y;
+	uint8_t	uc_iid_z;
+	uint8_t	uc_iid_btn[UTOUCH_BUTTON_MAX];
+	uint8_t	uc_nbuttons;
+
+	/*
+	 * Relative motion report of a pointer which can switch between
+	 * absolute and relative mode, and its buttons if they come in a
+	 * report of their own.  The wheel is only kept apart when the
+	 * report is in a top-level collection of its own.
+	 */
+	struct hid_location uc_loc_rx;
+	struct hid_location uc_loc_ry;
+	struct hid_location uc_loc_rz;
+	struct hid_location uc_loc_rbtn[UTOUCH_BUTTON_MAX];
+	uint8_t	uc_iid_rx;
+	uint8_t	uc_iid_ry;
+	uint8_t	uc_iid_rz;
+	uint8_t	uc_iid_rbtn[UTOUCH_BUTTON_MAX];
+	uint8_t	uc_rbuttons;	/* bitmask of uc_loc_rbtn set */
+	struct hid_location uc_field_loc[UTOUCH_FIELD_MAX];
+
+	struct hid_location uc_mt_loc[UTOUCH_MT_MAX][UTOUCH_MT_NUSAGES];
+	struct hid_location uc_mt_loc_count;
+	int32_t	uc_mt_count_max;
+	struct utouch_absinfo uc_ai_mt_x;
+	struct utouch_absinfo uc_ai_mt_y;
+	uint8_t	uc_mt_usages[UTOUCH_MT_MAX];	/* bitmask of usages found */
+
+	uint8_t	uc_tlc;		/* index among all top-level collections */
+};
+
+/*
+ * Decode plan: the report layout extracted from a HID report descriptor.
+ * Plans are immutable once built and are shared through a small module-wide
+ * cache keyed by descriptor hash, so that re-attaching the same device (or
+ * attaching several identical ones) does not parse the descriptor again.
+ */
+struct utouch_plan
+{
+	/*
+	 * Read for every report.  The collections come before the report ID
+	 * map, so that the fields of the first one share the line of the
+	 * flags.
+	 */
+	uint32_t up_flags;
+#define	UTOUCH_FLAG_HAS_ID	0x0100
+#define	UTOUCH_FLAG_FOLD_REL	0x0200	/* relative-only TLCs merged */
+	uint8_t	up_rdlen;	/* report bytes the fields may read */
+	uint8_t	up_ncolls;
+
+#define	UTOUCH_COLL_MAX		4
+	struct utouch_coll up_colls[UTOUCH_COLL_MAX];
+	uint8_t	up_coll_by_id[256];	/* collection index + 1 by report ID */
+
+	TAILQ_ENTRY(utouch_plan) up_link;
+	u_int	up_refs;
+	sbintime_t up_parse_time;	/* parse and compile time */
+	uint32_t up_hash;
+	uint16_t up_dlen;
+	uint8_t	up_desc[];	/* copy of the report descriptor */
+};
+
+/* Contact as last reported to evdev */
+struct utouch_mt_slot
+{
+	int32_t	ms_tid;		/* tracking ID, -1 if the slot is free */
+	int32_t	ms_cid;		/* contact ID assigned by the device */
+	int32_t	ms_x;
+	int32_t	ms_y;
+};
+
+/* Touching contact collected from the reports of the current frame */
+struct utouch_mt_contact
+{
+	int32_t	mc_cid;
+	int32_t	mc_x;
+	int32_t	mc_y;
+	int	mc_slot;
+};
+
+/*
+ * evdev device of a top-level collection, all a report of the collection
+ * touches of it.  Takes a single cache line, the touchscreen state is in
+ * struct utouch_mt.
+ */
+struct utouch_ev
+{
+	struct utouch_coll *ue_coll;
+	struct evdev_dev *ue_evdev;
+	struct utouch_softc *ue_sc;
+	u_int	ue_index;
+	u_int	ue_unsynced;	/* events pushed since the last sync */
+
+	/* Jitter filter, indexed by ABS_X and ABS_Y */
+	int32_t	ue_fuzz[2];
+	int32_t	ue_abs[2];	/* last value pushed */
+
+	uint16_t ue_btn_end;	/* first button code not reported */
+	/* Last button state pushed, by code, shared by both modes */
+	uint8_t	ue_last[UTOUCH_BUTTON_MAX];
+} __aligned(CACHE_LINE_SIZE);
+
+/* Multi-touch frame assembly and slot state of the collection of sc_ev */
+struct utouch_mt
+{
+	struct utouch_mt_slot um_slots[UTOUCH_MT_MAX];
+	struct utouch_mt_contact um_frame[UTOUCH_MT_MAX];
+	u_int	um_expect;	/* contacts in the current frame */
+	u_int	um_seen;	/* contacts received so far */
+	u_int	um_ntouch;	/* touching contacts received so far */
+	int32_t	um_slot;	/* last ABS_MT_SLOT pushed */
+	int32_t	um_tid;		/* next tracking ID */
+};
+
+/*
+ * Arrival statistics of the reports with one report ID.  The report IDs
+ * are kept apart in sc_arrival_ids, so a report touches only its entry.
+ */
+struct utouch_arrival
+{
+	sbintime_t ua_last;	/* arrival of the previous report */
+	uint64_t ua_count;	/* intervals in the moving averages */
+	int64_t	ua_avg;		/* moving average interval, ns */
+	int64_t	ua_dev;		/* moving mean absolute deviation, ns */
+#define	UTOUCH_ARRIVAL_BUCKETS	16
+	uint64_t ua_hist[UTOUCH_ARRIVAL_BUCKETS];	/* intervals, log2 us */
+} __aligned(CACHE_LINE_SIZE);
+
+/*
+ * Lock hold and wait time histograms by the code path taking the lock.
+ * Input and evdev run with the lock already taken by the transport and
+ * evdev, so only their hold times are known.
+ */
+enum {
+	UTOUCH_LOCK_INPUT,	/* report decoding */
+	UTOUCH_LOCK_EVDEV,	/* evdev open and close */
+	UTOUCH_LOCK_RAW,	/* raw device clients */
+	UTOUCH_LOCK_SYSCTL,
+	UTOUCH_LOCK_NPATHS,
+};
+
+struct utouch_lockprof
+{
+#define	UTOUCH_LOCK_BUCKETS	24
+	uint64_t lp_wait[UTOUCH_LOCK_BUCKETS];	/* log2 ns */
+	uint64_t lp_hold[UTOUCH_LOCK_BUCKETS];	/* log2 ns */
+};
+
+/*
+ * Decode and delivery settings which can be changed at run time.  The
+ * sysctl handlers replace the whole structure under sc_lock, so every
+ * report is handled with one consistent configuration.
+ */
+struct utouch_conf
+{
+	int	cf_fuzz[2];	/* by ABS_X and ABS_Y, -1 for auto */
+	int	cf_timestamps;	/* push MSC_TIMESTAMP */
+	int	cf_buttons;	/* buttons reported, the rest are ignored */
+	int	cf_stale_backlog; /* queued reports making one stale, 0 off */
+	int	cf_stale_age;	/* age making a report stale, us, 0 off */
+};
+
+/* Report waiting for the decode task */
+struct utouch_queued
+{
+	sbintime_t uq_time;	/* completion time */
+	int	uq_len;
+	uint8_t	uq_data[UTOUCH_BUFSIZE];
+};
+
+/*
+ * The head of the softc, up to sc_dev, is what decoding a report touches:
+ * two cache lines of flags, pointers, counters and the start of the report
+ * buffer, and the line of the collection in sc_ev.  The statistics with
+ * an entry or bucket per report and the touchscreen state come after the
+ * rest, which is attach time and configuration state.
+ */
+
+struct utouch_softc
+{
+	uint32_t sc_flags __aligned(CACHE_LINE_SIZE);
+#define	UTOUCH_FLAG_OPENED	0x0008
+#define	UTOUCH_FLAG_MISMATCH	0x0010
+#define	UTOUCH_FLAG_TIMESTAMP	0x0040
+#define	UTOUCH_FLAG_RAW_OPENED	0x0080
+#define	UTOUCH_FLAG_GONE	0x0200
+#define	UTOUCH_FLAG_READERS	(UTOUCH_FLAG_OPENED | UTOUCH_FLAG_RAW_OPENED)
+	uint32_t sc_ev_opened;	/* bitmask of open sc_ev */
+	struct mtx *sc_lock;	/* protects the softc, evdev lock */
+	struct utouch_plan *sc_plan;
+
+	/*
+	 * Reports waiting for the decode task, when decoding is deferred.
+	 * See below for the rest of the queue state.
+	 */
+	struct utouch_queued *sc_queue;
+
+	/* Statistics, read by utouchstat */
+	uint64_t sc_reports;	/* reports received */
+	uint64_t sc_ignored;	/* reports of collections nobody has open */
+	uint64_t sc_events;	/* events pushed, syncs excluded */
+	uint64_t sc_syncs;
+	uint64_t sc_unchanged;	/* reports which changed nothing */
+	uint64_t sc_filtered;	/* events dropped by the jitter filter */
+	uint64_t sc_stale;	/* stale reports dropped */
+
+#define	UTOUCH_ARRIVAL_IDS	8
+	uint8_t	sc_arrival_ids[UTOUCH_ARRIVAL_IDS]; /* report ID by sc_arrival */
+	uint8_t	sc_narrival;	/* sc_arrival entries in use */
+
+	/*
+	 * Report being processed, filled by the transport.  Reports of up
+	 * to 20 bytes stay in the line of the counters above.
+	 */
+	uint8_t	sc_temp[UTOUCH_BUFSIZE];
+
+	struct utouch_ev sc_ev[UTOUCH_COLL_MAX];
+
+	device_t sc_dev;
+
+	/* Identity reported through evdev */
+	uint16_t sc_bus;
+	uint16_t sc_vendor;
+	uint16_t sc_product;
+	uint16_t sc_version;
+	const char *sc_serial;
+
+	/*
+	 * Transport methods, called with sc_lock held when the first report
+	 * consumer appears and after the last one has gone.  Optional.
+	 */
+	void	(*sc_start)(struct utouch_softc *);
+	void	(*sc_stop)(struct utouch_softc *);
+
+	struct utouch_conf sc_conf;
+
+	/* Decode queue indices of sc_queue, free running */
+#define	UTOUCH_QUEUE_LEN	32	/* power of 2 */
+	u_int	sc_qhead;
+	u_int	sc_qtail;
+	uint64_t sc_overflows;	/* reports dropped on a full queue */
+	struct taskqueue *sc_tq;
+	struct task sc_decode_task;
+	int	sc_tq_cpu;	/* decode thread binding, -1 for none */
+	int	sc_tq_pri;	/* decode thread priority */
+
+	u_int	sc_verify_tick;
+	uint64_t sc_verified;
+	uint64_t sc_mismatches;
+
+	struct utouch_lockprof sc_lockprof[UTOUCH_LOCK_NPATHS];
+
+	/* Raw report device and its shared ring */
+	struct cdev *sc_raw_cdev;
+	struct selinfo sc_raw_rsel;
+	vm_object_t sc_raw_obj;
+	vm_offset_t sc_raw_kva;
+	vm_size_t sc_raw_size;
+	struct utouch_raw_header *sc_raw_hdr;
+	struct utouch_raw_record *sc_raw_rec;
+	u_int	sc_raw_opens;
+	u_int	sc_raw_batch;
+	uint64_t sc_raw_wakeup;
+
+	/* Statistics with a bucket or entry updated per report */
+#define	UTOUCH_LAT_BUCKETS	16
+	uint64_t sc_lat_hist[UTOUCH_LAT_BUCKETS]; /* receive to sync, log2 us */
+	struct utouch_arrival sc_arrival[UTOUCH_ARRIVAL_IDS];
+
+	struct utouch_mt sc_mt[UTOUCH_COLL_MAX];
+};
+
+/*
+ * Probe runs the parser on whatever the device hands out, so bound its
+ * cost.  Pointer descriptors are a few hundred bytes, but usage ranges and
+ * report counts let a short descriptor expand into very many items, hence
+ * the separate limit on the items walked.  Descriptors exceeding any of
+ * these are not matched.
+ */
+#define	UTOUCH_DESC_MAX		4096	/* descriptor bytes */
+#define	UTOUCH_PARSE_ITEMS_MAX	2048	/* items returned by hid_get_item() */
+#define	UTOUCH_PARSE_DEPTH_MAX	8	/* collection nesting */
+
+#define	UTOUCH_TEST_MOUSE	0x01
+#define	UTOUCH_TEST_TOUCH	0x02
+
+struct sbuf;
+
+int	utouch_hid_test(const void *, uint32_t, int);
+int	utouch_hid_scan(const void *, uint32_t, int);
+void	utouch_hid_parse(struct utouch_plan *, const void *, uint16_t);
+void	utouch_plan_compile(struct utouch_plan *);
+void	utouch_plan_layout(const struct utouch_plan *, struct sbuf *);
+int	utouch_core_init(struct utouch_softc *);
+int	utouch_core_attach(struct utouch_softc *, const void *, uint32_t, int);
+void	utouch_core_detach(struct utouch_softc *);
+void	utouch_core_free(struct utouch_softc *);
+void	utouch_core_input(struct utouch_softc *, int, sbintime_t);
+int	utouch_modevent(module_t, int, void *);
+
+#endif /* !_UTOUCH_H_ */
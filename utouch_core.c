@@ -0,0 +1,2040 @@
+/*-
+ * Copyright (c) 2014, Jakub Wojciech Klama <jceel@FreeBSD.org>
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/callout.h>
+#include <sys/conf.h>
+#include <sys/cpuset.h>
+#include <sys/endian.h>
+#include <sys/event.h>
+#include <sys/fcntl.h>
+#include <sys/hash.h>
+#include <sys/kernel.h>
+#include <sys/lock.h>
+#include <sys/malloc.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/poll.h>
+#include <sys/priority.h>
+#include <sys/queue.h>
+#include <sys/rwlock.h>
+#include <sys/sbuf.h>
+#include <sys/sdt.h>
+#include <sys/selinfo.h>
+#include <sys/smp.h>
+#include <sys/stddef.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include <vm/vm.h>
+#include <vm/vm_param.h>
+#include <vm/vm_extern.h>
+#include <vm/vm_kern.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_pager.h>
+#include <vm/pmap.h>
+
+#if __FreeBSD_version >= 1300134
+#include <dev/hid/hid.h>
+#endif
+
+#include <dev/usb/usb.h>
+#include <dev/usb/usbhid.h>
+
+/* Production builds have no debug printfs at all */
+#ifdef UTOUCH_NO_DEBUG
+#undef USB_DEBUG
+#endif
+#define	USB_DEBUG_VAR utouch_debug
+#include <dev/usb/usb_debug.h>
+
+#include <dev/evdev/input.h>
+#include <dev/evdev/evdev.h>
+
+#include "utouch_raw.h"
+#include "utouch.h"
+
+SYSCTL_NODE(_hw_usb, OID_AUTO, utouch, CTLFLAG_RW | CTLFLAG_MPSAFE, 0,
+    "USB touch");
+#ifdef USB_DEBUG
+int utouch_debug = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, debug, CTLFLAG_RWTUN, &utouch_debug, 0,
+    "Debug level");
+#endif
+
+/*
+ * DTrace probes, they cost nothing until enabled:
+ *   utouch:core:input:report	softc, report, length
+ *   utouch:core:decode:sync	softc, collection, events in the sync
+ *   utouch:core:decode:stale	softc, collection
+ */
+SDT_PROVIDER_DEFINE(utouch);
+SDT_PROBE_DEFINE3(utouch, core, input, report, "struct utouch_softc *",
+    "uint8_t *", "int");
+SDT_PROBE_DEFINE3(utouch, core, decode, sync, "struct utouch_softc *",
+    "u_int", "u_int");
+SDT_PROBE_DEFINE2(utouch, core, decode, stale, "struct utouch_softc *",
+    "u_int");
+
+/*
+ * Production builds leave out the decoder verification, lock profiling
+ * and the latency histogram, so that a report pays no loads, branches or
+ * clock reads for them.
+ */
+#ifdef UTOUCH_NO_DEBUG
+#define	utouch_lockprof	0
+#else
+static int utouch_verify = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, verify, CTLFLAG_RWTUN,
+    &utouch_verify, 0,
+    "Check one of every N reports against hid_get_data(), 0 to disable");
+static int utouch_lockprof = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, lockprof, CTLFLAG_RWTUN,
+    &utouch_lockprof, 0, "Profile driver lock hold and wait times");
+#endif
+static int utouch_timestamps = 1;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, timestamps, CTLFLAG_RDTUN,
+    &utouch_timestamps, 0,
+    "Report USB completion time with MSC_TIMESTAMP events");
+static int utouch_raw = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, raw, CTLFLAG_RDTUN,
+    &utouch_raw, 0, "Create /dev/utouchN.raw raw report devices");
+static int utouch_raw_records = 256;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, raw_records, CTLFLAG_RDTUN,
+    &utouch_raw_records, 0, "Number of reports kept in the raw report ring");
+static int utouch_fuzz_x = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, fuzz_x, CTLFLAG_RWTUN,
+    &utouch_fuzz_x, 0, "X axis jitter filter in device units, -1 for auto");
+static int utouch_fuzz_y = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, fuzz_y, CTLFLAG_RWTUN,
+    &utouch_fuzz_y, 0, "Y axis jitter filter in device units, -1 for auto");
+static int utouch_deferred = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, deferred, CTLFLAG_RDTUN,
+    &utouch_deferred, 0, "Decode reports in a per device thread");
+static int utouch_stale_backlog = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, stale_backlog, CTLFLAG_RWTUN,
+    &utouch_stale_backlog, 0,
+    "Queued reports making a position only report stale, 0 to disable");
+static int utouch_stale_age = 0;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, stale_age_us, CTLFLAG_RWTUN,
+    &utouch_stale_age, 0,
+    "Age making a queued position only report stale, us, 0 to disable");
+static int utouch_screen_width = 1920;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, screen_width, CTLFLAG_RWTUN,
+    &utouch_screen_width, 0, "Screen width in pixels for auto X fuzz");
+static int utouch_screen_height = 1080;
+SYSCTL_INT(_hw_usb_utouch, OID_AUTO, screen_height, CTLFLAG_RWTUN,
+    &utouch_screen_height, 0, "Screen height in pixels for auto Y fuzz");
+
+static MALLOC_DEFINE(M_UTOUCH, "utouch", "USB touch");
+
+/*
+ * Flags, pointers, counters and the first 24 bytes of the report buffer
+ * take two cache lines, and a collection one.
+ */
+CTASSERT(offsetof(struct utouch_softc, sc_temp) + 24 <= 2 * CACHE_LINE_SIZE);
+CTASSERT(sizeof(struct utouch_ev) == CACHE_LINE_SIZE);
+
+#define	UTOUCH_PLAN_CACHE_MAX	8
+
+static TAILQ_HEAD(utouch_plan_head, utouch_plan) utouch_plans =
+    TAILQ_HEAD_INITIALIZER(utouch_plans);
+static u_int utouch_nplans;
+static struct mtx utouch_plan_mtx;
+MTX_SYSINIT(utouch_plan, &utouch_plan_mtx, "utouch plans", MTX_DEF);
+
+/* Descriptor test statistics, to keep an eye on enumeration cost */
+#define	UTOUCH_PROBE_BUCKETS	16
+static uint64_t utouch_probe_tests;
+static uint64_t utouch_probe_matches;
+static uint64_t utouch_probe_hist[UTOUCH_PROBE_BUCKETS];
+static struct mtx utouch_probe_mtx;
+MTX_SYSINIT(utouch_probe, &utouch_probe_mtx, "utouch probe", MTX_DEF);
+SYSCTL_U64(_hw_usb_utouch, OID_AUTO, probe_tests, CTLFLAG_RD,
+    &utouch_probe_tests, 0, "Report descriptors tested in probe");
+SYSCTL_U64(_hw_usb_utouch, OID_AUTO, probe_matches, CTLFLAG_RD,
+    &utouch_probe_matches, 0, "Report descriptors accepted in probe");
+SYSCTL_OPAQUE(_hw_usb_utouch, OID_AUTO, probe_hist, CTLFLAG_RD,
+    utouch_probe_hist, sizeof(utouch_probe_hist), "QU",
+    "Descriptor test time, bucket N is [2^(N-1), 2^N) us");
+
+static void utouch_decode(struct utouch_softc *, uint8_t *, int, sbintime_t,
+		    bool);
+static void utouch_enqueue(struct utouch_softc *, int, sbintime_t);
+static task_fn_t utouch_decode_task;
+static bool utouch_mt_decode(struct utouch_ev *, const uint8_t *);
+static void utouch_mt_sync_frame(struct utouch_ev *);
+static void utouch_start_read(struct utouch_softc *, uint32_t);
+static void utouch_stop_read(struct utouch_softc *, uint32_t);
+
+static int utouch_raw_attach(struct utouch_softc *);
+static void utouch_raw_detach(struct utouch_softc *);
+static void utouch_raw_append(struct utouch_softc *, const uint8_t *, int,
+    sbintime_t);
+
+static int utouch_attach_coll(struct utouch_softc *, u_int);
+static void utouch_support_abs(struct evdev_dev *, uint16_t, int32_t, int32_t,
+    int32_t, int32_t);
+static void utouch_set_fuzz(struct evdev_dev *, uint16_t,
+    const struct utouch_absinfo *, int32_t, int32_t);
+static int32_t utouch_auto_fuzz(int, const struct utouch_absinfo *, int);
+static void utouch_conf_apply(struct utouch_softc *);
+static int utouch_conf_sysctl(SYSCTL_HANDLER_ARGS);
+static void utouch_arrival_update(struct utouch_softc *, uint8_t, sbintime_t);
+#ifndef UTOUCH_NO_DEBUG
+static int utouch_lockprof_sysctl(SYSCTL_HANDLER_ARGS);
+#endif
+static int utouch_arrival_sysctl(SYSCTL_HANDLER_ARGS);
+static int utouch_layout_sysctl(SYSCTL_HANDLER_ARGS);
+
+/*
+ * Report intervals longer than this are pauses in the input rather than
+ * the host polling period and are left out of the rate estimate.
+ */
+#define	UTOUCH_ARRIVAL_IDLE	(200 * SBT_1MS)
+
+#ifndef UTOUCH_NO_DEBUG
+static void utouch_verify_report(struct utouch_ev *, const uint8_t *, int,
+    uint8_t);
+#endif
+static struct utouch_plan *utouch_plan_get(const void *, uint16_t,
+	    uint32_t);
+static void utouch_plan_put(struct utouch_plan *);
+static void utouch_plan_flush(void);
+
+#if __FreeBSD_version >= 1200077
+static evdev_open_t utouch_ev_open;
+static evdev_close_t utouch_ev_close;
+#else
+static evdev_open_t utouch_ev_open_11;
+static evdev_close_t utouch_ev_close_11;
+#endif
+
+static const struct evdev_methods utouch_evdev_methods = {
+#if __FreeBSD_version >= 1200077
+	.ev_open = &utouch_ev_open,
+	.ev_close = &utouch_ev_close,
+#else
+	.ev_open = &utouch_ev_open_11,
+	.ev_close = &utouch_ev_close_11,
+#endif
+};
+
+static __inline u_int
+utouch_lockprof_bucket(sbintime_t t)
+{
+
+	return (MIN(flsll(sbttons(t)), UTOUCH_LOCK_BUCKETS - 1));
+}
+
+/*
+ * Start of a lock hold section for utouch_lockprof_hold(), 0 when lock
+ * profiling is off.
+ */
+static __inline sbintime_t
+utouch_lockprof_begin(void)
+{
+
+	return (utouch_lockprof ? sbinuptime() : 0);
+}
+
+static __inline void
+utouch_lockprof_hold(struct utouch_softc *sc, int path, sbintime_t t)
+{
+
+	if (t != 0)
+		sc->sc_lockprof[path].lp_hold[
+		    utouch_lockprof_bucket(sbinuptime() - t)]++;
+}
+
+/* mtx_lock() recording the wait time, returns what utouch_unlock() takes */
+static sbintime_t
+utouch_lock(struct utouch_softc *sc, int path)
+{
+	sbintime_t t0, t1;
+
+	if (!utouch_lockprof) {
+		mtx_lock(sc->sc_lock);
+		return (0);
+	}
+	t0 = sbinuptime();
+	mtx_lock(sc->sc_lock);
+	t1 = sbinuptime();
+	sc->sc_lockprof[path].lp_wait[utouch_lockprof_bucket(t1 - t0)]++;
+	return (t1);
+}
+
+static void
+utouch_unlock(struct utouch_softc *sc, int path, sbintime_t t)
+{
+
+	utouch_lockprof_hold(sc, path, t);
+	mtx_unlock(sc->sc_lock);
+}
+
+/*
+ * Device sysctls and the raw device, which do not depend on the report
+ * descriptor.  Called once from the transport attach method.
+ */
+int
+utouch_core_init(struct utouch_softc *sc)
+{
+	device_t dev = sc->sc_dev;
+	cpuset_t mask;
+	int cpu, pri;
+
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "reports", CTLFLAG_RD, &sc->sc_reports, 0,
+	    "Reports received");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "ignored", CTLFLAG_RD, &sc->sc_ignored, 0,
+	    "Reports of collections no evdev client has open");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "events", CTLFLAG_RD, &sc->sc_events, 0,
+	    "Input events pushed to evdev, syncs excluded");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "syncs", CTLFLAG_RD, &sc->sc_syncs, 0,
+	    "SYN_REPORT events pushed to evdev");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "unchanged", CTLFLAG_RD, &sc->sc_unchanged, 0,
+	    "Reports which changed nothing and were not synced");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "filtered", CTLFLAG_RD, &sc->sc_filtered, 0,
+	    "Coordinate changes dropped by the jitter filter");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "stale_dropped", CTLFLAG_RD, &sc->sc_stale, 0,
+	    "Position only reports dropped for a newer one under backlog");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "arrival", CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, sc, 0,
+	    utouch_arrival_sysctl, "A",
+	    "Report rate, burstiness and interval histogram per report ID");
+#ifndef UTOUCH_NO_DEBUG
+	SYSCTL_ADD_OPAQUE(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "latency_hist", CTLFLAG_RD | CTLFLAG_MPSAFE, sc->sc_lat_hist,
+	    sizeof(sc->sc_lat_hist), "QU",
+	    "Receive to evdev sync time, bucket N is [2^(N-1), 2^N) us");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "lockprof", CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, sc, 0,
+	    utouch_lockprof_sysctl, "A",
+	    "Lock wait and hold time histograms by code path");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "verified", CTLFLAG_RD, &sc->sc_verified, 0,
+	    "Reports checked against the reference decoder");
+	SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "verify_mismatches", CTLFLAG_RD, &sc->sc_mismatches, 0,
+	    "Fields decoded differently from the reference decoder");
+#endif
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "layout", CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, sc, 0,
+	    utouch_layout_sysctl, "A",
+	    "Report fields decoded, by collection, and descriptor parse time");
+
+	sc->sc_conf.cf_fuzz[ABS_X] = utouch_fuzz_x;
+	sc->sc_conf.cf_fuzz[ABS_Y] = utouch_fuzz_y;
+	sc->sc_conf.cf_timestamps = utouch_timestamps != 0;
+	sc->sc_conf.cf_buttons = UTOUCH_BUTTON_MAX;
+	sc->sc_conf.cf_stale_backlog = utouch_stale_backlog;
+	sc->sc_conf.cf_stale_age = utouch_stale_age;
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "fuzz_x", CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct utouch_conf, cf_fuzz[ABS_X]), utouch_conf_sysctl,
+	    "I", "X axis jitter filter, device units, -1 for auto");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "fuzz_y", CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct utouch_conf, cf_fuzz[ABS_Y]), utouch_conf_sysctl,
+	    "I", "Y axis jitter filter, device units, -1 for auto");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "timestamps", CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct utouch_conf, cf_timestamps), utouch_conf_sysctl,
+	    "I", "Report USB completion time with MSC_TIMESTAMP events");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "buttons", CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct utouch_conf, cf_buttons), utouch_conf_sysctl,
+	    "I", "Number of mouse buttons reported");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "stale_backlog", CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct utouch_conf, cf_stale_backlog), utouch_conf_sysctl,
+	    "I", "Queued reports making a position only report stale");
+	SYSCTL_ADD_PROC(device_get_sysctl_ctx(dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+	    "stale_age_us", CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, sc,
+	    offsetof(struct utouch_conf, cf_stale_age), utouch_conf_sysctl,
+	    "I", "Age making a queued position only report stale, us");
+
+	/*
+	 * Deferred decoding moves evdev delivery off the transport thread,
+	 * which lets reports queue up behind a slow consumer and be
+	 * dropped as stale instead of delivered late.  The decode thread
+	 * of a unit can be bound and prioritised with device hints, which
+	 * imply deferred decoding.
+	 */
+	sc->sc_tq_cpu = -1;
+	sc->sc_tq_pri = PI_SOFT;
+	cpu = resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "cpu", &sc->sc_tq_cpu);
+	pri = resource_int_value(device_get_name(dev), device_get_unit(dev),
+	    "priority", &sc->sc_tq_pri);
+	if (sc->sc_tq_cpu != -1 &&
+	    (sc->sc_tq_cpu < 0 || (u_int)sc->sc_tq_cpu > mp_maxid ||
+	    CPU_ABSENT(sc->sc_tq_cpu))) {
+		device_printf(dev, "ignoring invalid cpu hint %d\n",
+		    sc->sc_tq_cpu);
+		sc->sc_tq_cpu = -1;
+	}
+	if (sc->sc_tq_pri < PRI_MIN || sc->sc_tq_pri > PRI_MAX_KERN) {
+		device_printf(dev, "ignoring invalid priority hint %d\n",
+		    sc->sc_tq_pri);
+		sc->sc_tq_pri = PI_SOFT;
+	}
+	if (utouch_deferred || cpu == 0 || pri == 0) {
+		sc->sc_queue = malloc(sizeof(*sc->sc_queue) * UTOUCH_QUEUE_LEN,
+		    M_UTOUCH, M_WAITOK | M_ZERO);
+		SYSCTL_ADD_U64(device_get_sysctl_ctx(dev),
+		    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+		    "queue_overflows", CTLFLAG_RD, &sc->sc_overflows, 0,
+		    "Reports dropped on a full decode queue");
+		TASK_INIT(&sc->sc_decode_task, 0, utouch_decode_task, sc);
+		sc->sc_tq = taskqueue_create("utouch", M_WAITOK,
+		    taskqueue_thread_enqueue, &sc->sc_tq);
+		if (sc->sc_tq_cpu != -1) {
+			CPU_SETOF(sc->sc_tq_cpu, &mask);
+			taskqueue_start_threads_cpuset(&sc->sc_tq, 1,
+			    sc->sc_tq_pri, &mask, "%s taskq",
+			    device_get_nameunit(dev));
+		} else
+			taskqueue_start_threads(&sc->sc_tq, 1, sc->sc_tq_pri,
+			    "%s taskq", device_get_nameunit(dev));
+		SYSCTL_ADD_INT(device_get_sysctl_ctx(dev),
+		    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+		    "decode_cpu", CTLFLAG_RD, &sc->sc_tq_cpu, 0,
+		    "CPU the decode thread is bound to, -1 if not bound");
+		SYSCTL_ADD_INT(device_get_sysctl_ctx(dev),
+		    SYSCTL_CHILDREN(device_get_sysctl_tree(dev)), OID_AUTO,
+		    "decode_priority", CTLFLAG_RD, &sc->sc_tq_pri, 0,
+		    "Scheduling priority of the decode thread");
+	}
+
+	if (utouch_raw && utouch_raw_attach(sc) != 0)
+		return (ENXIO);
+
+	return (0);
+}
+
+/*
+ * Compiles the report descriptor and registers an evdev device per
+ * absolute pointer collection, or only for top-level collection tlc if
+ * it is not negative.
+ */
+int
+utouch_core_attach(struct utouch_softc *sc, const void *d_ptr,
+    uint32_t d_len, int tlc)
+{
+	struct utouch_plan *plan;
+	u_int i, n;
+	int err;
+
+	if (d_len > UTOUCH_DESC_MAX)
+		return (ENXIO);
+	/*
+	 * A relative-only collection can only be merged when the whole
+	 * device is ours, on hidbus(4) it is left to hms(4).
+	 */
+	plan = utouch_plan_get(d_ptr, d_len,
+	    tlc < 0 ? UTOUCH_FLAG_FOLD_REL : 0);
+
+	/* The input path and sysctls read sc_plan with the lock held */
+	mtx_lock(sc->sc_lock);
+	sc->sc_plan = plan;
+	for (i = 0; i < plan->up_ncolls; i++) {
+		sc->sc_ev[i].ue_sc = sc;
+		sc->sc_ev[i].ue_coll = &plan->up_colls[i];
+		sc->sc_ev[i].ue_index = i;
+	}
+	utouch_conf_apply(sc);
+	mtx_unlock(sc->sc_lock);
+
+	for (i = 0, n = 0; i < sc->sc_plan->up_ncolls; i++) {
+		if (tlc >= 0 && sc->sc_plan->up_colls[i].uc_tlc != tlc)
+			continue;
+		err = utouch_attach_coll(sc, i);
+		if (err != 0)
+			return (err);
+		n++;
+	}
+
+	return (n != 0 ? 0 : ENXIO);
+}
+
+static int
+utouch_attach_coll(struct utouch_softc *sc, u_int index)
+{
+	struct utouch_ev *ue = &sc->sc_ev[index];
+	struct utouch_mt *um = &sc->sc_mt[index];
+	struct utouch_coll *uc = ue->ue_coll;
+	char name[80];
+	int i, err;
+
+	/* announce information about the mouse */
+	if (uc->uc_flags & UTOUCH_FLAG_MOUSE)
+		device_printf(sc->sc_dev, "%d buttons and [%s%s%s] axes\n",
+		    (uc->uc_nbuttons),
+		    (uc->uc_flags & UTOUCH_FLAG_X_AXIS) ? "X" : "",
+		    (uc->uc_flags & UTOUCH_FLAG_Y_AXIS) ? "Y" : "",
+		    (uc->uc_flags & UTOUCH_FLAG_Z_AXIS) ? "Z" : "");
+	if (uc->uc_flags & (UTOUCH_FLAG_REL_X | UTOUCH_FLAG_REL_Y))
+		device_printf(sc->sc_dev, "relative mode [%s%s%s] axes\n",
+		    (uc->uc_flags & UTOUCH_FLAG_REL_X) ? "X" : "",
+		    (uc->uc_flags & UTOUCH_FLAG_REL_Y) ? "Y" : "",
+		    (uc->uc_flags & UTOUCH_FLAG_REL_Z) ? "Z" : "");
+	if (uc->uc_flags & UTOUCH_FLAG_MT)
+		device_printf(sc->sc_dev, "touchscreen, %d contacts\n",
+		    uc->uc_mt_nslots);
+
+	/* Tell the pointers apart when there are several of them */
+	if (sc->sc_plan->up_ncolls > 1)
+		snprintf(name, sizeof(name), "%s #%u",
+		    device_get_desc(sc->sc_dev), index + 1);
+	else
+		strlcpy(name, device_get_desc(sc->sc_dev), sizeof(name));
+
+	ue->ue_evdev = evdev_alloc();
+	evdev_set_name(ue->ue_evdev, name);
+	evdev_set_phys(ue->ue_evdev, device_get_nameunit(sc->sc_dev));
+	evdev_set_id(ue->ue_evdev, sc->sc_bus, sc->sc_vendor,
+	    sc->sc_product, sc->sc_version);
+	if (sc->sc_serial != NULL)
+		evdev_set_serial(ue->ue_evdev, sc->sc_serial);
+	evdev_set_methods(ue->ue_evdev, ue, &utouch_evdev_methods);
+	evdev_support_prop(ue->ue_evdev, INPUT_PROP_DIRECT);
+	evdev_support_event(ue->ue_evdev, EV_SYN);
+	evdev_support_event(ue->ue_evdev, EV_ABS);
+	evdev_support_event(ue->ue_evdev, EV_REL);
+	evdev_support_event(ue->ue_evdev, EV_KEY);
+
+	/* Report absolute axes information */
+	if (uc->uc_flags & UTOUCH_FLAG_X_AXIS)
+		utouch_support_abs(ue->ue_evdev, ABS_X, uc->uc_ai_x.min,
+		    uc->uc_ai_x.max, ue->ue_fuzz[ABS_X], uc->uc_ai_x.res);
+	if (uc->uc_flags & UTOUCH_FLAG_Y_AXIS)
+		utouch_support_abs(ue->ue_evdev, ABS_Y, uc->uc_ai_y.min,
+		    uc->uc_ai_y.max, ue->ue_fuzz[ABS_Y], uc->uc_ai_y.res);
+
+	if (uc->uc_flags & UTOUCH_FLAG_REL_X)
+		evdev_support_rel(ue->ue_evdev, REL_X);
+	if (uc->uc_flags & UTOUCH_FLAG_REL_Y)
+		evdev_support_rel(ue->ue_evdev, REL_Y);
+	if (uc->uc_flags & (UTOUCH_FLAG_Z_AXIS | UTOUCH_FLAG_REL_Z))
+		evdev_support_rel(ue->ue_evdev, REL_WHEEL);
+
+	for (i = 0; i < uc->uc_nbuttons; i++)
+		evdev_support_key(ue->ue_evdev, BTN_MOUSE + i);
+
+	/* Type B multi-touch with single-touch emulation for old clients */
+	if (uc->uc_flags & UTOUCH_FLAG_MT) {
+		utouch_support_abs(ue->ue_evdev, ABS_MT_SLOT, 0,
+		    uc->uc_mt_nslots - 1, 0, 0);
+		utouch_support_abs(ue->ue_evdev, ABS_MT_TRACKING_ID, -1,
+		    UTOUCH_MT_TID_MAX, 0, 0);
+		utouch_support_abs(ue->ue_evdev, ABS_MT_POSITION_X,
+		    uc->uc_ai_mt_x.min, uc->uc_ai_mt_x.max,
+		    ue->ue_fuzz[ABS_X], uc->uc_ai_mt_x.res);
+		utouch_support_abs(ue->ue_evdev, ABS_MT_POSITION_Y,
+		    uc->uc_ai_mt_y.min, uc->uc_ai_mt_y.max,
+		    ue->ue_fuzz[ABS_Y], uc->uc_ai_mt_y.res);
+		evdev_support_key(ue->ue_evdev, BTN_TOUCH);
+		evdev_support_mt_compat(ue->ue_evdev);
+
+		for (i = 0; i < UTOUCH_MT_MAX; i++)
+			um->um_slots[i].ms_tid = -1;
+		um->um_slot = -1;
+	}
+
+	/* Timestamps can be turned on at run time */
+	evdev_support_event(ue->ue_evdev, EV_MSC);
+	evdev_support_msc(ue->ue_evdev, MSC_TIMESTAMP);
+
+	err = evdev_register_mtx(ue->ue_evdev, sc->sc_lock);
+	if (err)
+		return (ENXIO);
+
+	return (0);
+}
+
+static void
+utouch_support_abs(struct evdev_dev *evdev, uint16_t code, int32_t min,
+    int32_t max, int32_t fuzz, int32_t res)
+{
+
+#if __FreeBSD_version >= 1300134
+	evdev_support_abs(evdev, code, min, max, fuzz, 0, res);
+#else
+	evdev_support_abs(evdev, code, 0, min, max, fuzz, 0, res);
+#endif
+}
+
+/*
+ * Update the fuzz reported for an axis of a registered evdev device.  The
+ * whole absinfo is replaced, so the current value has to be given.
+ */
+static void
+utouch_set_fuzz(struct evdev_dev *evdev, uint16_t code,
+    const struct utouch_absinfo *ai, int32_t fuzz, int32_t value)
+{
+	struct input_absinfo absinfo = {
+		.value = value,
+		.minimum = ai->min,
+		.maximum = ai->max,
+		.fuzz = fuzz,
+		.resolution = ai->res,
+	};
+
+	evdev_set_absinfo(evdev, code, &absinfo);
+}
+
+/*
+ * Unregisters the evdev devices and the raw device.  Must be called
+ * before the transport stops delivering reports for good.
+ */
+void
+utouch_core_detach(struct utouch_softc *sc)
+{
+	u_int i;
+
+	utouch_raw_detach(sc);
+
+	if (sc->sc_tq != NULL) {
+		mtx_lock(sc->sc_lock);
+		sc->sc_flags |= UTOUCH_FLAG_GONE;
+		sc->sc_qtail = sc->sc_qhead;
+		mtx_unlock(sc->sc_lock);
+		taskqueue_drain(sc->sc_tq, &sc->sc_decode_task);
+	}
+
+	for (i = 0; i < UTOUCH_COLL_MAX; i++)
+		evdev_free(sc->sc_ev[i].ue_evdev);
+}
+
+void
+utouch_core_free(struct utouch_softc *sc)
+{
+
+	if (sc->sc_plan != NULL)
+		utouch_plan_put(sc->sc_plan);
+	sc->sc_plan = NULL;
+	if (sc->sc_tq != NULL)
+		taskqueue_free(sc->sc_tq);
+	sc->sc_tq = NULL;
+	free(sc->sc_queue, M_UTOUCH);
+	sc->sc_queue = NULL;
+}
+
+/*
+ * Hands sc_temp[0..len) received at "now" to the consumers.  Called with
+ * the lock held.
+ */
+void
+utouch_core_input(struct utouch_softc *sc, int len, sbintime_t now)
+{
+	sbintime_t t;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+	t = utouch_lockprof_begin();
+	SDT_PROBE3(utouch, core, input, report, sc, sc->sc_temp, len);
+	sc->sc_reports++;
+	utouch_arrival_update(sc, (sc->sc_plan != NULL &&
+	    (sc->sc_plan->up_flags & UTOUCH_FLAG_HAS_ID)) ? sc->sc_temp[0] : 0,
+	    now);
+	if (sc->sc_flags & UTOUCH_FLAG_RAW_OPENED)
+		utouch_raw_append(sc, sc->sc_temp, len, now);
+	if ((sc->sc_flags & UTOUCH_FLAG_OPENED) && sc->sc_queue != NULL)
+		utouch_enqueue(sc, len, now);
+	else if (sc->sc_flags & UTOUCH_FLAG_OPENED)
+		utouch_decode(sc, sc->sc_temp, len, now, false);
+	utouch_lockprof_hold(sc, UTOUCH_LOCK_INPUT, t);
+}
+
+/*
+ * Queue sc_temp for the decode task.  On a full queue the oldest report
+ * is given up, a newer one is more useful.
+ */
+static void
+utouch_enqueue(struct utouch_softc *sc, int len, sbintime_t now)
+{
+	struct utouch_queued *uq;
+
+	if (sc->sc_flags & UTOUCH_FLAG_GONE)
+		return;
+	if (sc->sc_qhead - sc->sc_qtail == UTOUCH_QUEUE_LEN) {
+		sc->sc_qtail++;
+		sc->sc_overflows++;
+	}
+	uq = &sc->sc_queue[sc->sc_qhead & (UTOUCH_QUEUE_LEN - 1)];
+	uq->uq_time = now;
+	uq->uq_len = len;
+	memcpy(uq->uq_data, sc->sc_temp, len);
+	sc->sc_qhead++;
+	taskqueue_enqueue(sc->sc_tq, &sc->sc_decode_task);
+}
+
+/*
+ * Whether a report with the same report ID as the queued report at "pos"
+ * is queued after it.
+ */
+static bool
+utouch_queue_newer(struct utouch_softc *sc, u_int pos)
+{
+	uint8_t id;
+
+	if ((sc->sc_plan->up_flags & UTOUCH_FLAG_HAS_ID) == 0)
+		return (pos + 1 != sc->sc_qhead);
+	id = sc->sc_queue[pos & (UTOUCH_QUEUE_LEN - 1)].uq_data[0];
+	while (++pos != sc->sc_qhead)
+		if (sc->sc_queue[pos & (UTOUCH_QUEUE_LEN - 1)].uq_data[0] == id)
+			return (true);
+	return (false);
+}
+
+/*
+ * Decode the queued reports.  A report is stale when the backlog behind
+ * it or its age is past the limit and a newer report of the same
+ * collection is queued.  Stale reports are only dropped if all they
+ * change is the position, see utouch_decode().
+ */
+static void
+utouch_decode_task(void *arg, int pending)
+{
+	struct utouch_softc *sc = arg;
+	struct utouch_queued *uq;
+	sbintime_t t;
+	u_int backlog;
+	bool stale;
+
+	t = utouch_lock(sc, UTOUCH_LOCK_INPUT);
+	while (sc->sc_qtail != sc->sc_qhead) {
+		uq = &sc->sc_queue[sc->sc_qtail & (UTOUCH_QUEUE_LEN - 1)];
+		backlog = sc->sc_qhead - sc->sc_qtail - 1;
+		stale = backlog != 0 &&
+		    ((sc->sc_conf.cf_stale_backlog != 0 &&
+		    backlog >= (u_int)sc->sc_conf.cf_stale_backlog) ||
+		    (sc->sc_conf.cf_stale_age != 0 &&
+		    sbttous(sbinuptime() - uq->uq_time) >=
+		    sc->sc_conf.cf_stale_age)) &&
+		    utouch_queue_newer(sc, sc->sc_qtail);
+		sc->sc_qtail++;
+		if (sc->sc_flags & UTOUCH_FLAG_OPENED)
+			utouch_decode(sc, uq->uq_data, uq->uq_len, uq->uq_time,
+			    stale);
+	}
+	utouch_unlock(sc, UTOUCH_LOCK_INPUT, t);
+}
+
+/*
+ * Histogram the interval since the previous report with the same ID and
+ * update moving estimates of the host send period and of its deviation.
+ */
+static void
+utouch_arrival_update(struct utouch_softc *sc, uint8_t id, sbintime_t now)
+{
+	struct utouch_arrival *ua;
+	sbintime_t delta;
+	int64_t ns, d;
+	u_int i;
+
+	for (i = 0; i < sc->sc_narrival; i++)
+		if (sc->sc_arrival_ids[i] == id)
+			break;
+	if (i == UTOUCH_ARRIVAL_IDS)
+		return;
+	ua = &sc->sc_arrival[i];
+	if (i == sc->sc_narrival) {
+		sc->sc_arrival_ids[sc->sc_narrival++] = id;
+		ua->ua_last = now;
+		return;
+	}
+
+	delta = now - ua->ua_last;
+	ua->ua_last = now;
+	ns = sbttons(delta);
+	ua->ua_hist[MIN(flsll(ns / 1000), UTOUCH_ARRIVAL_BUCKETS - 1)]++;
+	if (delta > UTOUCH_ARRIVAL_IDLE)
+		return;
+
+	/* Weight 1/16, seeded with the first interval */
+	if (ua->ua_count++ == 0) {
+		ua->ua_avg = ns;
+		ua->ua_dev = 0;
+		return;
+	}
+	d = ns - ua->ua_avg;
+	ua->ua_avg += d / 16;
+	ua->ua_dev += ((d < 0 ? -d : d) - ua->ua_dev) / 16;
+}
+
+/*
+ * One line per report ID: intervals measured, estimated rate in Hz,
+ * burstiness as mean absolute deviation of the interval in percent of
+ * the interval, and the interval histogram.
+ */
+static int
+utouch_arrival_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct utouch_softc *sc = arg1;
+	struct utouch_arrival ua[UTOUCH_ARRIVAL_IDS], *a;
+	uint8_t ids[UTOUCH_ARRIVAL_IDS];
+	struct sbuf *sb;
+	sbintime_t t;
+	u_int i, b, n;
+	int err;
+
+	t = utouch_lock(sc, UTOUCH_LOCK_SYSCTL);
+	n = sc->sc_narrival;
+	memcpy(ids, sc->sc_arrival_ids, sizeof(ids));
+	memcpy(ua, sc->sc_arrival, sizeof(ua));
+	utouch_unlock(sc, UTOUCH_LOCK_SYSCTL, t);
+
+	sb = sbuf_new_for_sysctl(NULL, NULL, 256, req);
+	if (sb == NULL)
+		return (ENOMEM);
+	sbuf_printf(sb, "\nid count rate_hz burst_pct hist_log2_us");
+	for (i = 0; i < n; i++) {
+		a = &ua[i];
+		sbuf_printf(sb, "\n%u %ju %jd %jd", ids[i],
+		    (uintmax_t)a->ua_count,
+		    (intmax_t)(a->ua_avg > 0 ? 1000000000 / a->ua_avg : 0),
+		    (intmax_t)(a->ua_avg > 0 ? a->ua_dev * 100 / a->ua_avg : 0));
+		for (b = 0; b < UTOUCH_ARRIVAL_BUCKETS; b++)
+			sbuf_printf(sb, " %ju", (uintmax_t)a->ua_hist[b]);
+	}
+	err = sbuf_finish(sb);
+	sbuf_delete(sb);
+
+	return (err);
+}
+
+static int
+utouch_layout_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct utouch_softc *sc = arg1;
+	struct utouch_plan *plan;
+	struct sbuf *sb;
+	sbintime_t t;
+	int err;
+
+	/* Plans are immutable and outlive the devices using them */
+	t = utouch_lock(sc, UTOUCH_LOCK_SYSCTL);
+	plan = sc->sc_plan;
+	utouch_unlock(sc, UTOUCH_LOCK_SYSCTL, t);
+
+	sb = sbuf_new_for_sysctl(NULL, NULL, 512, req);
+	if (sb == NULL)
+		return (ENOMEM);
+	if (plan != NULL)
+		utouch_plan_layout(plan, sb);
+	err = sbuf_finish(sb);
+	sbuf_delete(sb);
+
+	return (err);
+}
+
+#ifndef UTOUCH_NO_DEBUG
+static int
+utouch_lockprof_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	static const char *paths[UTOUCH_LOCK_NPATHS] = {
+		[UTOUCH_LOCK_INPUT] = "input",
+		[UTOUCH_LOCK_EVDEV] = "evdev",
+		[UTOUCH_LOCK_RAW] = "raw",
+		[UTOUCH_LOCK_SYSCTL] = "sysctl",
+	};
+	struct utouch_softc *sc = arg1;
+	struct utouch_lockprof lp[UTOUCH_LOCK_NPATHS];
+	struct sbuf *sb;
+	sbintime_t t;
+	u_int i, b;
+	int err;
+
+	t = utouch_lock(sc, UTOUCH_LOCK_SYSCTL);
+	memcpy(lp, sc->sc_lockprof, sizeof(lp));
+	utouch_unlock(sc, UTOUCH_LOCK_SYSCTL, t);
+
+	sb = sbuf_new_for_sysctl(NULL, NULL, 512, req);
+	if (sb == NULL)
+		return (ENOMEM);
+	sbuf_printf(sb, "\npath what hist_log2_ns");
+	for (i = 0; i < UTOUCH_LOCK_NPATHS; i++) {
+		sbuf_printf(sb, "\n%s wait", paths[i]);
+		for (b = 0; b < UTOUCH_LOCK_BUCKETS; b++)
+			sbuf_printf(sb, " %ju", (uintmax_t)lp[i].lp_wait[b]);
+		sbuf_printf(sb, "\n%s hold", paths[i]);
+		for (b = 0; b < UTOUCH_LOCK_BUCKETS; b++)
+			sbuf_printf(sb, " %ju", (uintmax_t)lp[i].lp_hold[b]);
+	}
+	err = sbuf_finish(sb);
+	sbuf_delete(sb);
+
+	return (err);
+}
+#endif
+
+/*
+ * Fuzz for an axis: the tunable itself unless it is negative, otherwise
+ * half of the device units falling on a single screen pixel, so that
+ * changes which can not move the cursor are not reported.
+ */
+static int32_t
+utouch_auto_fuzz(int tunable, const struct utouch_absinfo *ai, int pixels)
+{
+
+	if (tunable >= 0)
+		return (tunable);
+	if (pixels <= 0)
+		return (0);
+	return ((((int64_t)ai->max - ai->min + 1) / pixels) / 2);
+}
+
+/*
+ * Derive the per evdev device state from sc_conf after it has changed.
+ */
+static void
+utouch_conf_apply(struct utouch_softc *sc)
+{
+	const struct utouch_absinfo *ai_x, *ai_y;
+	struct utouch_coll *uc;
+	struct utouch_ev *ue;
+	int32_t fuzz_x, fuzz_y;
+	u_int i, released;
+	uint16_t btn, btn_end;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+
+	if (sc->sc_conf.cf_timestamps)
+		sc->sc_flags |= UTOUCH_FLAG_TIMESTAMP;
+	else
+		sc->sc_flags &= ~UTOUCH_FLAG_TIMESTAMP;
+
+	for (i = 0; i < UTOUCH_COLL_MAX; i++) {
+		ue = &sc->sc_ev[i];
+		uc = ue->ue_coll;
+		if (uc == NULL)
+			continue;
+		ai_x = (uc->uc_flags & UTOUCH_FLAG_MT) ?
+		    &uc->uc_ai_mt_x : &uc->uc_ai_x;
+		ai_y = (uc->uc_flags & UTOUCH_FLAG_MT) ?
+		    &uc->uc_ai_mt_y : &uc->uc_ai_y;
+		fuzz_x = utouch_auto_fuzz(sc->sc_conf.cf_fuzz[ABS_X], ai_x,
+		    utouch_screen_width);
+		fuzz_y = utouch_auto_fuzz(sc->sc_conf.cf_fuzz[ABS_Y], ai_y,
+		    utouch_screen_height);
+		btn_end = BTN_MOUSE + sc->sc_conf.cf_buttons;
+
+		/*
+		 * Buttons no longer reported are released now, decoding skips
+		 * them and would never push their release.
+		 */
+		released = 0;
+		for (btn = btn_end; btn < ue->ue_btn_end; btn++) {
+			if (ue->ue_last[btn - BTN_MOUSE] == 0)
+				continue;
+			ue->ue_last[btn - BTN_MOUSE] = 0;
+			if (ue->ue_evdev == NULL)
+				continue;
+			evdev_push_key(ue->ue_evdev, btn, 0);
+			released++;
+		}
+		if (released != 0) {
+			evdev_sync(ue->ue_evdev);
+			ue->ue_unsynced = 0;
+			sc->sc_events += released;
+			sc->sc_syncs++;
+		}
+		ue->ue_btn_end = btn_end;
+
+		/*
+		 * Let the clients of an already registered device know.  The
+		 * touchscreen position values live in the slots, the absinfo
+		 * one is unused.  The single-touch emulation axes of a
+		 * touchscreen keep the fuzz they were registered with.
+		 */
+		if (ue->ue_evdev != NULL &&
+		    (fuzz_x != ue->ue_fuzz[ABS_X] ||
+		    fuzz_y != ue->ue_fuzz[ABS_Y])) {
+			if (uc->uc_flags & UTOUCH_FLAG_MT) {
+				utouch_set_fuzz(ue->ue_evdev,
+				    ABS_MT_POSITION_X, ai_x, fuzz_x, 0);
+				utouch_set_fuzz(ue->ue_evdev,
+				    ABS_MT_POSITION_Y, ai_y, fuzz_y, 0);
+			} else {
+				if (uc->uc_flags & UTOUCH_FLAG_X_AXIS)
+					utouch_set_fuzz(ue->ue_evdev, ABS_X,
+					    ai_x, fuzz_x, ue->ue_abs[ABS_X]);
+				if (uc->uc_flags & UTOUCH_FLAG_Y_AXIS)
+					utouch_set_fuzz(ue->ue_evdev, ABS_Y,
+					    ai_y, fuzz_y, ue->ue_abs[ABS_Y]);
+			}
+		}
+		ue->ue_fuzz[ABS_X] = fuzz_x;
+		ue->ue_fuzz[ABS_Y] = fuzz_y;
+	}
+}
+
+/*
+ * Setting of sc_conf at offset arg2.  The new configuration takes effect
+ * from the next report on.
+ */
+static int
+utouch_conf_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct utouch_softc *sc = arg1;
+	struct utouch_conf conf;
+	sbintime_t t;
+	int err, val;
+
+	t = utouch_lock(sc, UTOUCH_LOCK_SYSCTL);
+	val = *(int *)((char *)&sc->sc_conf + arg2);
+	utouch_unlock(sc, UTOUCH_LOCK_SYSCTL, t);
+
+	err = sysctl_handle_int(oidp, &val, 0, req);
+	if (err != 0 || req->newptr == NULL)
+		return (err);
+
+	switch (arg2) {
+	case offsetof(struct utouch_conf, cf_fuzz[ABS_X]):
+	case offsetof(struct utouch_conf, cf_fuzz[ABS_Y]):
+		if (val < -1)
+			return (EINVAL);
+		break;
+	case offsetof(struct utouch_conf, cf_timestamps):
+		if (val != 0 && val != 1)
+			return (EINVAL);
+		break;
+	case offsetof(struct utouch_conf, cf_buttons):
+		if (val < 0 || val > UTOUCH_BUTTON_MAX)
+			return (EINVAL);
+		break;
+	case offsetof(struct utouch_conf, cf_stale_backlog):
+	case offsetof(struct utouch_conf, cf_stale_age):
+		if (val < 0)
+			return (EINVAL);
+		break;
+	}
+
+	t = utouch_lock(sc, UTOUCH_LOCK_SYSCTL);
+	conf = sc->sc_conf;
+	*(int *)((char *)&conf + arg2) = val;
+	sc->sc_conf = conf;
+	utouch_conf_apply(sc);
+	utouch_unlock(sc, UTOUCH_LOCK_SYSCTL, t);
+
+	return (0);
+}
+
+/*
+ * Hysteresis: drop changes smaller than the fuzz from the last value
+ * pushed, they are sub-pixel noise.
+ */
+static __inline bool
+utouch_abs_moved(int32_t fuzz, int32_t last, int32_t value)
+{
+
+	return ((int64_t)value - last >= fuzz || (int64_t)last - value >= fuzz);
+}
+
+/*
+ * Collect the touching contacts of a report.  A frame can be spread over
+ * several reports ("hybrid mode"): the first one carries the number of
+ * contacts in the whole frame and the following ones a zero count.
+ * Returns true once the frame is complete and has been pushed to evdev.
+ */
+static bool
+utouch_mt_decode(struct utouch_ev *ue, const uint8_t *buf)
+{
+	struct utouch_coll *uc = ue->ue_coll;
+	struct utouch_mt *um = &ue->ue_sc->sc_mt[ue->ue_index];
+	struct utouch_field *uf;
+	struct utouch_mt_contact *mc;
+	u_int count, i, n;
+
+	if (uc->uc_flags & UTOUCH_FLAG_MT_COUNT)
+		count = utouch_field_value(buf, &uc->uc_mt_count);
+	else
+		count = uc->uc_mt_ncontacts;
+
+	if (count != 0 || um->um_seen >= um->um_expect) {
+		um->um_expect = count;
+		um->um_seen = 0;
+		um->um_ntouch = 0;
+	}
+
+	n = MIN(uc->uc_mt_ncontacts, um->um_expect - um->um_seen);
+	for (i = 0; i < n; i++) {
+		uf = uc->uc_mt_fields[i];
+		if (utouch_field_value(buf, &uf[UTOUCH_MT_TIP]) == 0 ||
+		    um->um_ntouch >= uc->uc_mt_nslots)
+			continue;
+		mc = &um->um_frame[um->um_ntouch++];
+		if (uc->uc_mt_usages[i] & (1 << UTOUCH_MT_ID))
+			mc->mc_cid = utouch_field_value(buf, &uf[UTOUCH_MT_ID]);
+		else
+			mc->mc_cid = um->um_seen + i;
+		mc->mc_x = utouch_field_value(buf, &uf[UTOUCH_MT_X]);
+		mc->mc_y = utouch_field_value(buf, &uf[UTOUCH_MT_Y]);
+	}
+	um->um_seen += n;
+
+	if (um->um_seen < um->um_expect)
+		return (false);
+
+	utouch_mt_sync_frame(ue);
+	return (true);
+}
+
+static void
+utouch_mt_push(struct utouch_ev *ue, int slot, uint16_t code, int32_t value)
+{
+	struct utouch_mt *um = &ue->ue_sc->sc_mt[ue->ue_index];
+
+	if (um->um_slot != slot) {
+		evdev_push_abs(ue->ue_evdev, ABS_MT_SLOT, slot);
+		um->um_slot = slot;
+		ue->ue_unsynced++;
+		ue->ue_sc->sc_events++;
+	}
+	evdev_push_abs(ue->ue_evdev, code, value);
+	ue->ue_unsynced++;
+	ue->ue_sc->sc_events++;
+}
+
+/*
+ * Match the contacts of a complete frame to slots by contact ID and push
+ * only what changed since the previous frame.
+ */
+static void
+utouch_mt_sync_frame(struct utouch_ev *ue)
+{
+	struct utouch_mt *um = &ue->ue_sc->sc_mt[ue->ue_index];
+	struct utouch_mt_contact *mc, *mc_end;
+	struct utouch_mt_slot *ms;
+	uint32_t used;
+	u_int nslots, s, unsynced;
+	bool new;
+
+	nslots = ue->ue_coll->uc_mt_nslots;
+	mc_end = um->um_frame + um->um_ntouch;
+	used = 0;
+	unsynced = ue->ue_unsynced;
+
+	/* Contacts which are still down keep their slots */
+	for (mc = um->um_frame; mc < mc_end; mc++) {
+		mc->mc_slot = -1;
+		for (s = 0; s < nslots; s++) {
+			ms = &um->um_slots[s];
+			if (ms->ms_tid != -1 && ms->ms_cid == mc->mc_cid &&
+			    (used & (1U << s)) == 0) {
+				mc->mc_slot = s;
+				used |= 1U << s;
+				break;
+			}
+		}
+	}
+
+	/* Release the slots of lifted contacts */
+	for (s = 0; s < nslots; s++) {
+		ms = &um->um_slots[s];
+		if (ms->ms_tid != -1 && (used & (1U << s)) == 0) {
+			utouch_mt_push(ue, s, ABS_MT_TRACKING_ID, -1);
+			ms->ms_tid = -1;
+		}
+	}
+
+	for (mc = um->um_frame; mc < mc_end; mc++) {
+		new = mc->mc_slot == -1;
+		if (new) {
+			/* There are never more contacts than slots */
+			for (s = 0; um->um_slots[s].ms_tid != -1; s++)
+				;
+			mc->mc_slot = s;
+			ms = &um->um_slots[s];
+			ms->ms_cid = mc->mc_cid;
+			ms->ms_tid = um->um_tid;
+			um->um_tid = (um->um_tid + 1) & UTOUCH_MT_TID_MAX;
+			utouch_mt_push(ue, s, ABS_MT_TRACKING_ID, ms->ms_tid);
+		} else
+			ms = &um->um_slots[mc->mc_slot];
+
+		if (new || (ms->ms_x != mc->mc_x &&
+		    utouch_abs_moved(ue->ue_fuzz[ABS_X], ms->ms_x, mc->mc_x))) {
+			utouch_mt_push(ue, mc->mc_slot, ABS_MT_POSITION_X,
+			    mc->mc_x);
+			ms->ms_x = mc->mc_x;
+		} else if (ms->ms_x != mc->mc_x)
+			ue->ue_sc->sc_filtered++;
+		if (new || (ms->ms_y != mc->mc_y &&
+		    utouch_abs_moved(ue->ue_fuzz[ABS_Y], ms->ms_y, mc->mc_y))) {
+			utouch_mt_push(ue, mc->mc_slot, ABS_MT_POSITION_Y,
+			    mc->mc_y);
+			ms->ms_y = mc->mc_y;
+		} else if (ms->ms_y != mc->mc_y)
+			ue->ue_sc->sc_filtered++;
+	}
+
+	/* Single touch state can only change with the slots */
+	if (ue->ue_unsynced != unsynced)
+		evdev_push_mt_compat(ue->ue_evdev);
+}
+
+/*
+ * Events of a report are decoded in to an array first and pushed to evdev
+ * in one go afterwards, see utouch_push_events().  Values evdev would
+ * discard anyway, unchanged buttons and zero relative motion, are dropped
+ * on the way, and reports which leave nothing to push are not synced, so
+ * that evdev clients are not woken up for them.
+ */
+struct utouch_event
+{
+	uint16_t ev_type;
+	uint16_t ev_code;
+	int32_t	ev_value;
+};
+
+/*
+ * evdev(4) has no call taking several events.  The evdev devices are
+ * registered with sc_lock as their lock, so evdev_push_event() only
+ * asserts it and the whole array goes out under the single hold taken
+ * for the report, with no lock traffic per event.
+ */
+static void
+utouch_push_events(struct utouch_ev *ue, const struct utouch_event *evs,
+    u_int n)
+{
+	u_int i;
+
+	mtx_assert(ue->ue_sc->sc_lock, MA_OWNED);
+	for (i = 0; i < n; i++) {
+		evdev_push_event(ue->ue_evdev, evs[i].ev_type, evs[i].ev_code,
+		    evs[i].ev_value);
+		if (evs[i].ev_type == EV_ABS)
+			ue->ue_abs[evs[i].ev_code] = evs[i].ev_value;
+	}
+}
+
+static void
+utouch_decode(struct utouch_softc *sc, uint8_t *buf, int len, sbintime_t now,
+    bool stale)
+{
+	struct utouch_plan *plan = sc->sc_plan;
+	struct utouch_event evs[UTOUCH_FIELD_MAX];
+	struct utouch_coll *uc;
+	struct utouch_field *uf;
+	struct utouch_ev *ue;
+	int32_t value;
+	uint8_t id, index;
+	u_int i, n;
+
+	/* Fields reaching past a short report must read zeroes */
+	if (len < plan->up_rdlen)
+		memset(buf + len, 0, plan->up_rdlen - len);
+
+	id = 0;
+	if (plan->up_flags & UTOUCH_FLAG_HAS_ID) {
+		id = *buf;
+		len--;
+		buf++;
+	}
+
+	/* Reports of collections nobody listens to are dropped here */
+	index = plan->up_coll_by_id[id];
+	if (index == 0 || (sc->sc_ev_opened & (1U << (index - 1))) == 0) {
+		sc->sc_ignored++;
+		return;
+	}
+	ue = &sc->sc_ev[index - 1];
+	uc = ue->ue_coll;
+
+	n = 0;
+	for (i = 0; i < uc->uc_nfields; i++) {
+		uf = &uc->uc_fields[i];
+		if (uf->uf_id != id)
+			continue;
+		value = utouch_field_get(buf, uf);
+		switch (uf->uf_type) {
+		case EV_ABS:
+			/* The only absolute fields are ABS_X and ABS_Y */
+			if (value == ue->ue_abs[uf->uf_code])
+				continue;
+			if (!utouch_abs_moved(ue->ue_fuzz[uf->uf_code],
+			    ue->ue_abs[uf->uf_code], value)) {
+				sc->sc_filtered++;
+				continue;
+			}
+			break;
+		case EV_REL:
+			if (value == 0)
+				continue;
+			break;
+		case EV_KEY:
+			/* Like evdev_push_key(), a 1-bit field reads -1 */
+			value = value != 0;
+			if (uf->uf_code >= ue->ue_btn_end ||
+			    ue->ue_last[uf->uf_code - BTN_MOUSE] == value)
+				continue;
+			ue->ue_last[uf->uf_code - BTN_MOUSE] = value;
+			break;
+		}
+		evs[n].ev_type = uf->uf_type;
+		evs[n].ev_code = uf->uf_code;
+		evs[n].ev_value = value;
+		n++;
+	}
+
+	/*
+	 * A newer report will move the pointer anyway.  Button and wheel
+	 * changes and touch frames are never dropped.
+	 */
+	if (stale && (uc->uc_flags & UTOUCH_FLAG_MT) == 0) {
+		for (i = 0; i < n && evs[i].ev_type == EV_ABS; i++)
+			;
+		if (n != 0 && i == n) {
+			SDT_PROBE2(utouch, core, decode, stale, sc,
+			    ue->ue_index);
+			sc->sc_stale++;
+			return;
+		}
+	}
+
+	utouch_push_events(ue, evs, n);
+	ue->ue_unsynced += n;
+	sc->sc_events += n;
+
+#ifndef UTOUCH_NO_DEBUG
+	if (utouch_verify != 0 &&
+	    ++sc->sc_verify_tick >= (u_int)utouch_verify) {
+		sc->sc_verify_tick = 0;
+		utouch_verify_report(ue, buf, len, id);
+	}
+#endif
+
+	/* Nothing to sync until the last report of a touch frame */
+	if ((uc->uc_flags & UTOUCH_FLAG_MT) && id == uc->uc_iid_mt &&
+	    !utouch_mt_decode(ue, buf))
+		return;
+
+	if (ue->ue_unsynced == 0) {
+		sc->sc_unchanged++;
+		return;
+	}
+
+	/* Like Linux, MSC_TIMESTAMP is in microseconds and wraps */
+	if (sc->sc_flags & UTOUCH_FLAG_TIMESTAMP)
+		evdev_push_event(ue->ue_evdev, EV_MSC, MSC_TIMESTAMP,
+		    (int32_t)sbttous(now));
+
+	SDT_PROBE3(utouch, core, decode, sync, sc, ue->ue_index,
+	    ue->ue_unsynced);
+	evdev_sync(ue->ue_evdev);
+	ue->ue_unsynced = 0;
+	sc->sc_syncs++;
+#ifndef UTOUCH_NO_DEBUG
+	sc->sc_lat_hist[MIN(flsll(sbttous(sbinuptime() - now)),
+	    UTOUCH_LAT_BUCKETS - 1)]++;
+#endif
+}
+
+#ifndef UTOUCH_NO_DEBUG
+/*
+ * Compare a compiled field against hid_get_data(), or hid_get_udata()
+ * for unsigned fields.  "what" names the field in the mismatch message.
+ */
+static void
+utouch_verify_field(struct utouch_ev *ue, const uint8_t *buf, int len,
+    const struct utouch_field *uf, const struct hid_location *loc,
+    const char *what, const uint8_t *report, int rlen)
+{
+	struct utouch_softc *sc = ue->ue_sc;
+	int32_t fast, ref;
+
+	fast = utouch_field_value(buf, uf);
+	if (uf->uf_flags & UTOUCH_FIELD_UNSIGNED)
+		ref = hid_get_udata(buf, len, __DECONST(struct hid_location *,
+		    loc));
+	else
+		ref = hid_get_data(buf, len, __DECONST(struct hid_location *,
+		    loc));
+	if (fast == ref)
+		return;
+	sc->sc_mismatches++;
+	if (sc->sc_flags & UTOUCH_FLAG_MISMATCH)
+		return;
+	sc->sc_flags |= UTOUCH_FLAG_MISMATCH;
+	device_printf(sc->sc_dev, "decoder mismatch on %s: got %d, "
+	    "expected %d\n", what, fast, ref);
+	hexdump(sc->sc_plan->up_desc, sc->sc_plan->up_dlen,
+	    "utouch desc:   ", 0);
+	hexdump(report, rlen, "utouch report: ", 0);
+}
+
+/*
+ * Decode the report again with the reference hid_get_data() and compare
+ * the results against the compiled fields, touch contacts included.  The
+ * descriptor and the report are dumped on the first mismatch.  "buf" and
+ * "len" are past the report ID.
+ */
+static void
+utouch_verify_report(struct utouch_ev *ue, const uint8_t *buf, int len,
+    uint8_t id)
+{
+	struct utouch_coll *uc = ue->ue_coll;
+	struct utouch_field *uf;
+	const uint8_t *report;
+	char what[32];
+	u_int i, u;
+	int rlen;
+
+	ue->ue_sc->sc_verified++;
+	report = buf;
+	rlen = len;
+	if (ue->ue_sc->sc_plan->up_flags & UTOUCH_FLAG_HAS_ID) {
+		report--;
+		rlen++;
+	}
+	for (i = 0; i < uc->uc_nfields; i++) {
+		uf = &uc->uc_fields[i];
+		if (uf->uf_id != id)
+			continue;
+		snprintf(what, sizeof(what), "event %u:%u", uf->uf_type,
+		    uf->uf_code);
+		utouch_verify_field(ue, buf, len, uf, &uc->uc_field_loc[i],
+		    what, report, rlen);
+	}
+
+	if ((uc->uc_flags & UTOUCH_FLAG_MT) == 0 || id != uc->uc_iid_mt)
+		return;
+	if (uc->uc_flags & UTOUCH_FLAG_MT_COUNT)
+		utouch_verify_field(ue, buf, len, &uc->uc_mt_count,
+		    &uc->uc_mt_loc_count, "contact count", report, rlen);
+	for (i = 0; i < uc->uc_mt_ncontacts; i++) {
+		for (u = 0; u < UTOUCH_MT_NUSAGES; u++) {
+			if ((uc->uc_mt_usages[i] & (1 << u)) == 0)
+				continue;
+			snprintf(what, sizeof(what), "contact %u usage %u",
+			    i, u);
+			utouch_verify_field(ue, buf, len,
+			    &uc->uc_mt_fields[i][u], &uc->uc_mt_loc[i][u],
+			    what, report, rlen);
+		}
+	}
+}
+#endif
+
+/*
+ * The transport delivers reports while there is at least one consumer of
+ * them, an evdev client or the raw device.
+ */
+static void
+utouch_start_read(struct utouch_softc *sc, uint32_t who)
+{
+	bool first;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+	first = (sc->sc_flags & UTOUCH_FLAG_READERS) == 0;
+	sc->sc_flags |= who;
+	if (first && sc->sc_start != NULL)
+		sc->sc_start(sc);
+}
+
+static void
+utouch_stop_read(struct utouch_softc *sc, uint32_t who)
+{
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+	sc->sc_flags &= ~who;
+	if ((sc->sc_flags & UTOUCH_FLAG_READERS) == 0 && sc->sc_stop != NULL)
+		sc->sc_stop(sc);
+}
+
+static void
+utouch_ev_close_11(struct evdev_dev *evdev, void *ev_softc)
+{
+	struct utouch_ev *ue = ev_softc;
+	struct utouch_softc *sc = ue->ue_sc;
+	sbintime_t t;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+	t = utouch_lockprof_begin();
+	sc->sc_ev_opened &= ~(1U << ue->ue_index);
+	if (sc->sc_ev_opened == 0)
+		utouch_stop_read(sc, UTOUCH_FLAG_OPENED);
+	utouch_lockprof_hold(sc, UTOUCH_LOCK_EVDEV, t);
+}
+
+static int
+utouch_ev_open_11(struct evdev_dev *evdev, void *ev_softc)
+{
+	struct utouch_ev *ue = ev_softc;
+	struct utouch_softc *sc = ue->ue_sc;
+	sbintime_t t;
+
+        mtx_assert(sc->sc_lock, MA_OWNED);
+	t = utouch_lockprof_begin();
+	sc->sc_ev_opened |= 1U << ue->ue_index;
+	utouch_start_read(sc, UTOUCH_FLAG_OPENED);
+	utouch_lockprof_hold(sc, UTOUCH_LOCK_EVDEV, t);
+
+        return (0);
+}
+
+#if __FreeBSD_version >= 1200077
+static int
+utouch_ev_close(struct evdev_dev *evdev)
+{
+	struct utouch_ev *ue = evdev_get_softc(evdev);
+
+	utouch_ev_close_11(evdev, ue);
+
+	return (0);
+}
+
+static int
+utouch_ev_open(struct evdev_dev *evdev)
+{
+	struct utouch_ev *ue = evdev_get_softc(evdev);
+
+	return (utouch_ev_open_11(evdev, ue));
+}
+#endif
+
+struct utouch_raw_priv
+{
+	struct utouch_softc *rp_sc;
+	uint64_t rp_seen;		/* urh_head at the last read(2) */
+};
+
+static d_open_t utouch_raw_open;
+static d_read_t utouch_raw_read;
+static d_poll_t utouch_raw_poll;
+static d_kqfilter_t utouch_raw_kqfilter;
+static d_mmap_single_t utouch_raw_mmap_single;
+
+static struct cdevsw utouch_raw_cdevsw = {
+	.d_version = D_VERSION,
+	.d_name = "utouch_raw",
+	.d_open = utouch_raw_open,
+	.d_read = utouch_raw_read,
+	.d_poll = utouch_raw_poll,
+	.d_kqfilter = utouch_raw_kqfilter,
+	.d_mmap_single = utouch_raw_mmap_single,
+};
+
+static void utouch_raw_kqdetach(struct knote *);
+static int utouch_raw_kqevent(struct knote *, long);
+
+static struct filterops utouch_raw_filterops = {
+	.f_isfd = 1,
+	.f_detach = utouch_raw_kqdetach,
+	.f_event = utouch_raw_kqevent,
+};
+
+/*
+ * The ring lives in an OBJT_PHYS VM object, which is mapped in to the
+ * kernel for the producer and handed out to mmap(2) for consumers.  User
+ * mappings hold their own object references, so the pages outlive detach
+ * for as long as they stay mapped.
+ */
+static int
+utouch_raw_attach(struct utouch_softc *sc)
+{
+	struct make_dev_args mda;
+	vm_page_t *m;
+	u_int nrecords, npages, i;
+	int err;
+
+	nrecords = utouch_raw_records;
+	if (nrecords < 16)
+		nrecords = 16;
+	if (nrecords > 65536)
+		nrecords = 65536;
+	/* Round down to a power of 2 */
+	nrecords = 1U << (fls(nrecords) - 1);
+
+	sc->sc_raw_size = round_page(roundup2(sizeof(struct utouch_raw_header),
+	    CACHE_LINE_SIZE) + nrecords * sizeof(struct utouch_raw_record));
+	npages = atop(sc->sc_raw_size);
+
+	sc->sc_raw_obj = vm_pager_allocate(OBJT_PHYS, NULL, sc->sc_raw_size,
+	    VM_PROT_DEFAULT, 0, NULL);
+	m = malloc(npages * sizeof(*m), M_TEMP, M_WAITOK);
+	VM_OBJECT_WLOCK(sc->sc_raw_obj);
+	for (i = 0; i < npages; i++) {
+#if __FreeBSD_version >= 1300000
+		m[i] = vm_page_grab(sc->sc_raw_obj, i, VM_ALLOC_ZERO);
+		vm_page_valid(m[i]);
+		vm_page_xunbusy(m[i]);
+#else
+		m[i] = vm_page_grab(sc->sc_raw_obj, i,
+		    VM_ALLOC_NOBUSY | VM_ALLOC_ZERO);
+		m[i]->valid = VM_PAGE_BITS_ALL;
+#endif
+	}
+	VM_OBJECT_WUNLOCK(sc->sc_raw_obj);
+	sc->sc_raw_kva = kva_alloc(sc->sc_raw_size);
+	pmap_qenter(sc->sc_raw_kva, m, npages);
+	free(m, M_TEMP);
+	memset((void *)sc->sc_raw_kva, 0, sc->sc_raw_size);
+
+	sc->sc_raw_hdr = (struct utouch_raw_header *)sc->sc_raw_kva;
+	*sc->sc_raw_hdr = (struct utouch_raw_header) {
+		.urh_magic = UTOUCH_RAW_MAGIC,
+		.urh_version = UTOUCH_RAW_VERSION,
+		.urh_nrecords = nrecords,
+		.urh_recsize = sizeof(struct utouch_raw_record),
+		.urh_offset = roundup2(sizeof(struct utouch_raw_header),
+		    CACHE_LINE_SIZE),
+	};
+	sc->sc_raw_rec = (struct utouch_raw_record *)
+	    (sc->sc_raw_kva + sc->sc_raw_hdr->urh_offset);
+	sc->sc_raw_batch = 1;
+
+	knlist_init_mtx(&sc->sc_raw_rsel.si_note, sc->sc_lock);
+
+	SYSCTL_ADD_UINT(device_get_sysctl_ctx(sc->sc_dev),
+	    SYSCTL_CHILDREN(device_get_sysctl_tree(sc->sc_dev)), OID_AUTO,
+	    "raw_batch", CTLFLAG_RW, &sc->sc_raw_batch, 0,
+	    "Raw reports to accumulate before waking up readers");
+
+	make_dev_args_init(&mda);
+	mda.mda_devsw = &utouch_raw_cdevsw;
+	mda.mda_uid = UID_ROOT;
+	mda.mda_gid = GID_OPERATOR;
+	mda.mda_mode = 0640;
+	mda.mda_si_drv1 = sc;
+	err = make_dev_s(&mda, &sc->sc_raw_cdev, "%s.raw",
+	    device_get_nameunit(sc->sc_dev));
+	if (err != 0)
+		device_printf(sc->sc_dev, "failed to create raw device: %d\n",
+		    err);
+	return (err);
+}
+
+static void
+utouch_raw_detach(struct utouch_softc *sc)
+{
+
+	if (sc->sc_raw_obj == NULL)
+		return;
+
+	if (sc->sc_raw_cdev != NULL) {
+		/* Kick out sleeping readers before destroy_dev() waits */
+		mtx_lock(sc->sc_lock);
+		sc->sc_flags |= UTOUCH_FLAG_GONE;
+		wakeup(&sc->sc_raw_hdr);
+		mtx_unlock(sc->sc_lock);
+		destroy_dev(sc->sc_raw_cdev);
+	}
+
+	seldrain(&sc->sc_raw_rsel);
+	knlist_clear(&sc->sc_raw_rsel.si_note, 0);
+	knlist_destroy(&sc->sc_raw_rsel.si_note);
+
+	pmap_qremove(sc->sc_raw_kva, atop(sc->sc_raw_size));
+	kva_free(sc->sc_raw_kva, sc->sc_raw_size);
+	vm_object_deallocate(sc->sc_raw_obj);
+	sc->sc_raw_obj = NULL;
+}
+
+static void
+utouch_raw_append(struct utouch_softc *sc, const uint8_t *buf, int len,
+    sbintime_t now)
+{
+	struct utouch_raw_header *hdr = sc->sc_raw_hdr;
+	struct utouch_raw_record *rec;
+	uint64_t head;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+
+	head = hdr->urh_head;
+	rec = &sc->sc_raw_rec[head & (hdr->urh_nrecords - 1)];
+
+	/* Invalidate the slot while it is being rewritten */
+	rec->urr_seq = UINT64_MAX;
+	atomic_thread_fence_rel();
+	rec->urr_time = sbttons(now);
+	rec->urr_len = len;
+	memcpy(rec->urr_data, buf, len);
+	atomic_store_rel_64(&rec->urr_seq, head);
+	atomic_store_rel_64(&hdr->urh_head, head + 1);
+
+	if (head + 1 - sc->sc_raw_wakeup < MAX(sc->sc_raw_batch, 1))
+		return;
+	sc->sc_raw_wakeup = head + 1;
+	wakeup(&sc->sc_raw_hdr);
+	selwakeup(&sc->sc_raw_rsel);
+	KNOTE_LOCKED(&sc->sc_raw_rsel.si_note, 0);
+}
+
+static bool
+utouch_raw_ready(struct utouch_softc *sc, struct utouch_raw_priv *rp)
+{
+
+	return (sc->sc_raw_hdr->urh_head - rp->rp_seen >=
+	    MAX(sc->sc_raw_batch, 1));
+}
+
+static void
+utouch_raw_dtor(void *data)
+{
+	struct utouch_raw_priv *rp = data;
+	struct utouch_softc *sc = rp->rp_sc;
+	sbintime_t t;
+
+	t = utouch_lock(sc, UTOUCH_LOCK_RAW);
+	if (--sc->sc_raw_opens == 0)
+		utouch_stop_read(sc, UTOUCH_FLAG_RAW_OPENED);
+	utouch_unlock(sc, UTOUCH_LOCK_RAW, t);
+	free(rp, M_UTOUCH);
+}
+
+static int
+utouch_raw_open(struct cdev *dev, int oflags, int devtype, struct thread *td)
+{
+	struct utouch_softc *sc = dev->si_drv1;
+	struct utouch_raw_priv *rp;
+	sbintime_t t;
+	int err;
+
+	if (oflags & FWRITE)
+		return (EPERM);
+
+	rp = malloc(sizeof(*rp), M_UTOUCH, M_WAITOK | M_ZERO);
+	rp->rp_sc = sc;
+	err = devfs_set_cdevpriv(rp, utouch_raw_dtor);
+	if (err != 0) {
+		free(rp, M_UTOUCH);
+		return (err);
+	}
+
+	t = utouch_lock(sc, UTOUCH_LOCK_RAW);
+	rp->rp_seen = sc->sc_raw_hdr->urh_head;
+	if (sc->sc_raw_opens++ == 0)
+		utouch_start_read(sc, UTOUCH_FLAG_RAW_OPENED);
+	utouch_unlock(sc, UTOUCH_LOCK_RAW, t);
+
+	return (0);
+}
+
+static int
+utouch_raw_read(struct cdev *dev, struct uio *uio, int ioflag)
+{
+	struct utouch_softc *sc = dev->si_drv1;
+	struct utouch_raw_priv *rp;
+	sbintime_t t;
+	uint64_t head;
+	int err;
+
+	if (uio->uio_resid < (ssize_t)sizeof(head))
+		return (EINVAL);
+	err = devfs_get_cdevpriv((void **)&rp);
+	if (err != 0)
+		return (err);
+
+	t = utouch_lock(sc, UTOUCH_LOCK_RAW);
+	while (!utouch_raw_ready(sc, rp)) {
+		if (sc->sc_flags & UTOUCH_FLAG_GONE) {
+			err = ENXIO;
+			break;
+		}
+		if (ioflag & IO_NDELAY) {
+			/* Do not wait for a full batch without blocking */
+			if (sc->sc_raw_hdr->urh_head == rp->rp_seen)
+				err = EWOULDBLOCK;
+			break;
+		}
+		/* The lock is not held while sleeping */
+		utouch_lockprof_hold(sc, UTOUCH_LOCK_RAW, t);
+		err = msleep(&sc->sc_raw_hdr, sc->sc_lock, PCATCH, "utraw", 0);
+		t = utouch_lockprof_begin();
+		if (err != 0)
+			break;
+	}
+	head = sc->sc_raw_hdr->urh_head;
+	if (err == 0)
+		rp->rp_seen = head;
+	utouch_unlock(sc, UTOUCH_LOCK_RAW, t);
+
+	if (err == 0)
+		err = uiomove(&head, sizeof(head), uio);
+	return (err);
+}
+
+static int
+utouch_raw_poll(struct cdev *dev, int events, struct thread *td)
+{
+	struct utouch_softc *sc = dev->si_drv1;
+	struct utouch_raw_priv *rp;
+	sbintime_t t;
+	int revents = 0;
+
+	if (devfs_get_cdevpriv((void **)&rp) != 0)
+		return (POLLHUP);
+
+	if (events & (POLLIN | POLLRDNORM)) {
+		t = utouch_lock(sc, UTOUCH_LOCK_RAW);
+		if (utouch_raw_ready(sc, rp) || (sc->sc_flags & UTOUCH_FLAG_GONE))
+			revents = events & (POLLIN | POLLRDNORM);
+		else
+			selrecord(td, &sc->sc_raw_rsel);
+		utouch_unlock(sc, UTOUCH_LOCK_RAW, t);
+	}
+
+	return (revents);
+}
+
+static int
+utouch_raw_kqfilter(struct cdev *dev, struct knote *kn)
+{
+	struct utouch_softc *sc = dev->si_drv1;
+	struct utouch_raw_priv *rp;
+	int err;
+
+	if (kn->kn_filter != EVFILT_READ)
+		return (EINVAL);
+	err = devfs_get_cdevpriv((void **)&rp);
+	if (err != 0)
+		return (err);
+
+	kn->kn_fop = &utouch_raw_filterops;
+	kn->kn_hook = rp;
+	knlist_add(&sc->sc_raw_rsel.si_note, kn, 0);
+
+	return (0);
+}
+
+static void
+utouch_raw_kqdetach(struct knote *kn)
+{
+	struct utouch_raw_priv *rp = kn->kn_hook;
+
+	knlist_remove(&rp->rp_sc->sc_raw_rsel.si_note, kn, 0);
+}
+
+static int
+utouch_raw_kqevent(struct knote *kn, long hint)
+{
+	struct utouch_raw_priv *rp = kn->kn_hook;
+	struct utouch_softc *sc = rp->rp_sc;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+
+	if (sc->sc_flags & UTOUCH_FLAG_GONE) {
+		kn->kn_flags |= EV_EOF;
+		return (1);
+	}
+	kn->kn_data = sc->sc_raw_hdr->urh_head - rp->rp_seen;
+	return (utouch_raw_ready(sc, rp));
+}
+
+static int
+utouch_raw_mmap_single(struct cdev *dev, vm_ooffset_t *offset, vm_size_t size,
+    struct vm_object **object, int nprot)
+{
+	struct utouch_softc *sc = dev->si_drv1;
+
+	/* The ring is written by the driver only */
+	if (nprot & VM_PROT_WRITE)
+		return (EACCES);
+	if (*offset > sc->sc_raw_size || size > sc->sc_raw_size - *offset)
+		return (EINVAL);
+
+	vm_object_reference(sc->sc_raw_obj);
+	*object = sc->sc_raw_obj;
+	return (0);
+}
+
+/*
+ * Returns which kinds of absolute pointer collections, UTOUCH_TEST_MOUSE
+ * and/or UTOUCH_TEST_TOUCH, the report descriptor has.  With tlc >= 0 only
+ * the top-level collection of that index is looked at.
+ */
+int
+utouch_hid_test(const void *d_ptr, uint32_t d_len, int tlc)
+{
+	sbintime_t t;
+	int found;
+
+	t = sbinuptime();
+	found = utouch_hid_scan(d_ptr, d_len, tlc);
+	t = sbinuptime() - t;
+
+	mtx_lock(&utouch_probe_mtx);
+	utouch_probe_tests++;
+	if (found != 0)
+		utouch_probe_matches++;
+	utouch_probe_hist[MIN(flsll(sbttous(t)), UTOUCH_PROBE_BUCKETS - 1)]++;
+	mtx_unlock(&utouch_probe_mtx);
+
+	DPRINTFN(1, "descriptor of %u bytes tested in %ju us: %d\n", d_len,
+	    (uintmax_t)sbttous(t), found);
+	return (found);
+}
+
+/*
+ * Look up a decode plan for the given report descriptor and parse flags
+ * in the module-wide cache, building and inserting a new one on miss.
+ * Returns a referenced plan which must be released with utouch_plan_put().
+ */
+static struct utouch_plan *
+utouch_plan_get(const void *d_ptr, uint16_t d_len, uint32_t flags)
+{
+	struct utouch_plan *plan, *new, *tmp;
+	uint32_t hash;
+
+	hash = hash32_buf(d_ptr, d_len, HASHINIT);
+
+	new = NULL;
+	mtx_lock(&utouch_plan_mtx);
+	for (;;) {
+		TAILQ_FOREACH(plan, &utouch_plans, up_link) {
+			if (plan->up_hash == hash && plan->up_dlen == d_len &&
+			    (plan->up_flags & UTOUCH_FLAG_FOLD_REL) == flags &&
+			    memcmp(plan->up_desc, d_ptr, d_len) == 0)
+				break;
+		}
+		if (plan != NULL) {
+			/* Cache hit, keep the list in LRU order */
+			plan->up_refs++;
+			TAILQ_REMOVE(&utouch_plans, plan, up_link);
+			TAILQ_INSERT_HEAD(&utouch_plans, plan, up_link);
+			mtx_unlock(&utouch_plan_mtx);
+			DPRINTFN(1, "reusing cached plan %08x\n", hash);
+			free(new, M_UTOUCH);
+			return (plan);
+		}
+		if (new != NULL)
+			break;
+
+		/* Parse without the lock held and look again afterwards */
+		mtx_unlock(&utouch_plan_mtx);
+		new = malloc(sizeof(*new) + d_len, M_UTOUCH, M_WAITOK | M_ZERO);
+		new->up_hash = hash;
+		new->up_dlen = d_len;
+		new->up_flags = flags;
+		memcpy(new->up_desc, d_ptr, d_len);
+		new->up_parse_time = sbinuptime();
+		utouch_hid_parse(new, d_ptr, d_len);
+		utouch_plan_compile(new);
+		new->up_parse_time = sbinuptime() - new->up_parse_time;
+		DPRINTFN(1, "plan %08x built in %ju us\n", hash,
+		    (uintmax_t)sbttous(new->up_parse_time));
+		mtx_lock(&utouch_plan_mtx);
+	}
+
+	new->up_refs = 1;
+	TAILQ_INSERT_HEAD(&utouch_plans, new, up_link);
+	utouch_nplans++;
+
+	/* Evict least recently used plans nobody is attached to */
+	TAILQ_FOREACH_REVERSE_SAFE(plan, &utouch_plans, utouch_plan_head,
+	    up_link, tmp) {
+		if (utouch_nplans <= UTOUCH_PLAN_CACHE_MAX)
+			break;
+		if (plan->up_refs != 0)
+			continue;
+		TAILQ_REMOVE(&utouch_plans, plan, up_link);
+		utouch_nplans--;
+		free(plan, M_UTOUCH);
+	}
+	mtx_unlock(&utouch_plan_mtx);
+
+	return (new);
+}
+
+static void
+utouch_plan_put(struct utouch_plan *plan)
+{
+
+	mtx_lock(&utouch_plan_mtx);
+	KASSERT(plan->up_refs > 0, ("utouch plan refcount underflow"));
+	plan->up_refs--;
+	mtx_unlock(&utouch_plan_mtx);
+}
+
+static void
+utouch_plan_flush(void)
+{
+	struct utouch_plan *plan, *tmp;
+
+	/*
+	 * Every attachment driver unloads on its own, skip the plans the
+	 * devices of the others still hold.
+	 */
+	mtx_lock(&utouch_plan_mtx);
+	TAILQ_FOREACH_SAFE(plan, &utouch_plans, up_link, tmp) {
+		if (plan->up_refs != 0)
+			continue;
+		TAILQ_REMOVE(&utouch_plans, plan, up_link);
+		utouch_nplans--;
+		free(plan, M_UTOUCH);
+	}
+	mtx_unlock(&utouch_plan_mtx);
+}
+
+int
+utouch_modevent(module_t mod, int what, void *arg)
+{
+
+	switch (what) {
+	case MOD_UNLOAD:
+		utouch_plan_flush();
+		break;
+	default:
+		break;
+	}
+	return (0);
+}
@@ -0,0 +1,691 @@
+/*-
+ * Copyright (c) 2014, Jakub Wojciech Klama <jceel@FreeBSD.org>
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * Report descriptor analysis: the probe test and the decode plan builder.
+ * Kept free of anything but the HID parser so that it can be built in to
+ * the userspace harness, see harness/.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/endian.h>
+#include <sys/kernel.h>
+#include <sys/lock.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/queue.h>
+#include <sys/sbuf.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/time.h>
+
+#include <vm/vm.h>
+
+#if __FreeBSD_version >= 1300134
+#include <dev/hid/hid.h>
+#endif
+
+#include <dev/usb/usb.h>
+#include <dev/usb/usbhid.h>
+
+#ifdef UTOUCH_NO_DEBUG
+#undef USB_DEBUG
+#endif
+#define	USB_DEBUG_VAR utouch_debug
+#include <dev/usb/usb_debug.h>
+
+#include <dev/evdev/input.h>
+
+#include "utouch.h"
+
+/* Windows 8 digitizer usages, missing from older usbhid.h */
+#ifndef HUD_CONTACTID
+#define	HUD_CONTACTID		0x0051
+#endif
+#ifndef HUD_CONTACTCOUNT
+#define	HUD_CONTACTCOUNT	0x0054
+#endif
+
+/*
+ * Descriptor test behind utouch_hid_test(), without the statistics.
+ */
+int
+utouch_hid_scan(const void *d_ptr, uint32_t d_len, int tlc)
+{
+	struct hid_data *hd;
+	struct hid_item hi;
+	int mdepth, kind, nitems, ntlc;
+	int found;
+
+	if (d_len > UTOUCH_DESC_MAX) {
+		DPRINTF("descriptor too large: %u bytes\n", d_len);
+		return (0);
+	}
+
+	hd = hid_start_parse(d_ptr, d_len, 1 << hid_input);
+	if (hd == NULL)
+		return (0);
+
+	mdepth = 0;
+	kind = 0;
+	found = 0;
+	nitems = 0;
+	ntlc = -1;
+
+	while (hid_get_item(hd, &hi)) {
+		if (++nitems > UTOUCH_PARSE_ITEMS_MAX ||
+		    hi.collevel > UTOUCH_PARSE_DEPTH_MAX) {
+			DPRINTF("descriptor too complex\n");
+			found = 0;
+			break;
+		}
+		switch (hi.kind) {
+		case hid_collection:
+			if (hi.collevel == 1)
+				ntlc++;
+			if (mdepth != 0)
+				mdepth++;
+			else if (hi.collevel != 1 ||
+			    (tlc >= 0 && ntlc != tlc))
+				break;
+			else if (hi.collection == 1 &&
+			     hi.usage ==
+			      HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_MOUSE)) {
+				mdepth++;
+				kind = UTOUCH_TEST_MOUSE;
+			} else if (hi.collection == 1 &&
+			     hi.usage ==
+			      HID_USAGE2(HUP_DIGITIZERS, HUD_TOUCHSCREEN)) {
+				mdepth++;
+				kind = UTOUCH_TEST_TOUCH;
+			}
+			break;
+		case hid_endcollection:
+			if (mdepth != 0)
+				mdepth--;
+			break;
+		case hid_input:
+			if (mdepth == 0)
+				break;
+			if (hi.usage ==
+			     HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_X) &&
+			    (hi.flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE)
+				found |= kind;
+			if (hi.usage ==
+			     HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_Y) &&
+			    (hi.flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE)
+				found |= kind;
+			break;
+		default:
+			break;
+		}
+	}
+	hid_end_parse(hd);
+	return (found);
+}
+
+/*
+ * Touchscreen input item: contact count at the top level of the
+ * application collection, the rest in the contact collections.
+ */
+static void
+utouch_hid_parse_mt(struct utouch_coll *uc, const struct hid_item *hi,
+    int contact)
+{
+	struct utouch_absinfo ai;
+	int usage;
+
+	if ((hi->flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) != HIO_VARIABLE)
+		return;
+
+	/* All of a frame has to come in the same report */
+	if (uc->uc_flags & (UTOUCH_FLAG_MT | UTOUCH_FLAG_MT_COUNT)) {
+		if (hi->report_ID != uc->uc_iid_mt)
+			return;
+	} else
+		uc->uc_iid_mt = hi->report_ID;
+
+	if (contact < 0) {
+		if (hi->usage == HID_USAGE2(HUP_DIGITIZERS, HUD_CONTACTCOUNT)) {
+			uc->uc_flags |= UTOUCH_FLAG_MT_COUNT;
+			uc->uc_mt_loc_count = hi->loc;
+			uc->uc_mt_count_max = hi->logical_maximum;
+		}
+		return;
+	}
+
+	if (hi->usage == HID_USAGE2(HUP_DIGITIZERS, HUD_TIP_SWITCH))
+		usage = UTOUCH_MT_TIP;
+	else if (hi->usage == HID_USAGE2(HUP_DIGITIZERS, HUD_CONTACTID))
+		usage = UTOUCH_MT_ID;
+	else if (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_X))
+		usage = UTOUCH_MT_X;
+	else if (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_Y))
+		usage = UTOUCH_MT_Y;
+	else
+		return;
+
+	uc->uc_flags |= UTOUCH_FLAG_MT;
+	uc->uc_mt_loc[contact][usage] = hi->loc;
+	uc->uc_mt_usages[contact] |= 1 << usage;
+	if (usage == UTOUCH_MT_X || usage == UTOUCH_MT_Y) {
+		ai = (struct utouch_absinfo) {
+			.max = hi->logical_maximum,
+			.min = hi->logical_minimum,
+			.res = hid_item_resolution(__DECONST(struct hid_item *,
+			    hi)),
+		};
+		if (usage == UTOUCH_MT_X)
+			uc->uc_ai_mt_x = ai;
+		else
+			uc->uc_ai_mt_y = ai;
+	}
+}
+
+/*
+ * Mouse input item.  Like hid_locate() would, take the first non-constant
+ * occurence of each button and of the wheel, preferring the vertical one.
+ */
+static void
+utouch_hid_parse_mouse(struct utouch_coll *uc, const struct hid_item *hi,
+    uint8_t *buttons, uint8_t *wheel)
+{
+	uint8_t i;
+
+	if (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_X) &&
+	    (hi->flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE) {
+		uc->uc_flags |= UTOUCH_FLAG_X_AXIS;
+		uc->uc_loc_x = hi->loc;
+		uc->uc_iid_x = hi->report_ID;
+		uc->uc_ai_x = (struct utouch_absinfo) {
+			.max = hi->logical_maximum,
+			.min = hi->logical_minimum,
+			.res = hid_item_resolution(__DECONST(struct hid_item *,
+			    hi)),
+		};
+	}
+	if (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_Y) &&
+	    (hi->flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) == HIO_VARIABLE) {
+		uc->uc_flags |= UTOUCH_FLAG_Y_AXIS;
+		uc->uc_loc_y = hi->loc;
+		uc->uc_iid_y = hi->report_ID;
+		uc->uc_ai_y = (struct utouch_absinfo) {
+			.max = hi->logical_maximum,
+			.min = hi->logical_minimum,
+			.res = hid_item_resolution(__DECONST(struct hid_item *,
+			    hi)),
+		};
+	}
+
+	/* Hypervisors switching to relative mode send these instead */
+	if (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_X) &&
+	    (hi->flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) ==
+	    (HIO_VARIABLE|HIO_RELATIVE) &&
+	    (uc->uc_flags & UTOUCH_FLAG_REL_X) == 0) {
+		uc->uc_flags |= UTOUCH_FLAG_REL_X;
+		uc->uc_loc_rx = hi->loc;
+		uc->uc_iid_rx = hi->report_ID;
+	}
+	if (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_Y) &&
+	    (hi->flags & (HIO_CONST|HIO_VARIABLE|HIO_RELATIVE)) ==
+	    (HIO_VARIABLE|HIO_RELATIVE) &&
+	    (uc->uc_flags & UTOUCH_FLAG_REL_Y) == 0) {
+		uc->uc_flags |= UTOUCH_FLAG_REL_Y;
+		uc->uc_loc_ry = hi->loc;
+		uc->uc_iid_ry = hi->report_ID;
+	}
+
+	if (hi->flags & HIO_CONST)
+		return;
+
+	/* Try the wheel first as the Z activator since it's tradition. */
+	if ((hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_WHEEL) &&
+	    *wheel < 2) ||
+	    (hi->usage == HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_TWHEEL) &&
+	    *wheel < 1)) {
+		*wheel = hi->usage ==
+		    HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_WHEEL) ? 2 : 1;
+		uc->uc_loc_z = hi->loc;
+		uc->uc_iid_z = hi->report_ID;
+		if (hi->flags & HIO_VARIABLE)
+			uc->uc_flags |= UTOUCH_FLAG_Z_AXIS;
+		else
+			uc->uc_flags &= ~UTOUCH_FLAG_Z_AXIS;
+	}
+
+	if (HID_GET_USAGE_PAGE(hi->usage) == HUP_BUTTON &&
+	    HID_GET_USAGE(hi->usage) >= 1 &&
+	    HID_GET_USAGE(hi->usage) <= UTOUCH_BUTTON_MAX) {
+		i = HID_GET_USAGE(hi->usage) - 1;
+		if ((*buttons & (1 << i)) == 0) {
+			*buttons |= 1 << i;
+			uc->uc_loc_btn[i] = hi->loc;
+			uc->uc_iid_btn[i] = hi->report_ID;
+		} else if (hi->report_ID != uc->uc_iid_btn[i] &&
+		    (uc->uc_rbuttons & (1 << i)) == 0) {
+			/* Same button in the report of the other mode */
+			uc->uc_rbuttons |= 1 << i;
+			uc->uc_loc_rbtn[i] = hi->loc;
+			uc->uc_iid_rbtn[i] = hi->report_ID;
+		}
+	}
+}
+
+/*
+ * Returns false if the collection has nothing usable.
+ */
+static bool
+utouch_hid_parse_finish(struct utouch_coll *uc, uint8_t buttons)
+{
+	uint8_t i, n;
+
+	/* Buttons are numbered from 1 without gaps */
+	for (i = 0; i < UTOUCH_BUTTON_MAX; i++)
+		if ((buttons & (1 << i)) == 0)
+			break;
+	uc->uc_nbuttons = i;
+
+	/*
+	 * Relative axes alone do not make an absolute pointer, plain
+	 * mice are left to ums(4).
+	 */
+	if ((uc->uc_flags & (UTOUCH_FLAG_X_AXIS | UTOUCH_FLAG_Y_AXIS)) == 0)
+		uc->uc_flags &= ~(UTOUCH_FLAG_REL_X | UTOUCH_FLAG_REL_Y);
+	if (uc->uc_flags & (UTOUCH_FLAG_X_AXIS | UTOUCH_FLAG_Y_AXIS))
+		return (true);
+
+	/* Keep the contact collections which are usable */
+	for (i = 0, n = 0; i < uc->uc_mt_ncontacts; i++) {
+		if ((~uc->uc_mt_usages[i] & ((1 << UTOUCH_MT_TIP) |
+		    (1 << UTOUCH_MT_X) | (1 << UTOUCH_MT_Y))) != 0)
+			continue;
+		memcpy(uc->uc_mt_loc[n], uc->uc_mt_loc[i],
+		    sizeof(uc->uc_mt_loc[n]));
+		uc->uc_mt_usages[n++] = uc->uc_mt_usages[i];
+	}
+	uc->uc_mt_ncontacts = n;
+	if (n == 0)
+		return (false);
+
+	/*
+	 * In hybrid mode the contact count may exceed the contacts in one
+	 * report, take its logical maximum as the number of slots.
+	 */
+	uc->uc_mt_nslots = n;
+	if (uc->uc_flags & UTOUCH_FLAG_MT_COUNT)
+		uc->uc_mt_nslots = MAX(n, MIN(uc->uc_mt_count_max,
+		    UTOUCH_MT_MAX));
+	return (true);
+}
+
+/*
+ * Some hypervisors send the relative mode reports of a switchable pointer
+ * from a top-level collection of its own.  Decode them as the relative
+ * mode of the first absolute pointer which has none, so that a mode
+ * switch keeps the same evdev device.  Their buttons become a second
+ * location of the same buttons, their wheel a wheel of its own.
+ */
+static void
+utouch_hid_parse_fold(struct utouch_plan *plan, const uint8_t *buttons)
+{
+	struct utouch_coll *uc, *rc;
+	uint8_t i, j, b;
+
+	/* Without report IDs the reports cannot be told apart */
+	if ((plan->up_flags & UTOUCH_FLAG_HAS_ID) == 0)
+		return;
+
+	for (i = 0; i < plan->up_ncolls; i++) {
+		uc = &plan->up_colls[i];
+		if ((uc->uc_flags &
+		    (UTOUCH_FLAG_X_AXIS | UTOUCH_FLAG_Y_AXIS)) != 0 &&
+		    (uc->uc_flags &
+		    (UTOUCH_FLAG_REL_X | UTOUCH_FLAG_REL_Y)) == 0 &&
+		    uc->uc_rbuttons == 0)
+			break;
+	}
+	if (i == plan->up_ncolls)
+		return;
+
+	for (j = 0; j < plan->up_ncolls; j++) {
+		rc = &plan->up_colls[j];
+		if ((rc->uc_flags &
+		    (UTOUCH_FLAG_X_AXIS | UTOUCH_FLAG_Y_AXIS)) != 0 ||
+		    (rc->uc_flags &
+		    (UTOUCH_FLAG_REL_X | UTOUCH_FLAG_REL_Y)) == 0)
+			continue;
+		uc->uc_flags |= rc->uc_flags &
+		    (UTOUCH_FLAG_REL_X | UTOUCH_FLAG_REL_Y);
+		uc->uc_loc_rx = rc->uc_loc_rx;
+		uc->uc_iid_rx = rc->uc_iid_rx;
+		uc->uc_loc_ry = rc->uc_loc_ry;
+		uc->uc_iid_ry = rc->uc_iid_ry;
+		if (rc->uc_flags & UTOUCH_FLAG_Z_AXIS) {
+			uc->uc_flags |= UTOUCH_FLAG_REL_Z;
+			uc->uc_loc_rz = rc->uc_loc_z;
+			uc->uc_iid_rz = rc->uc_iid_z;
+		}
+		for (b = 0; b < UTOUCH_BUTTON_MAX; b++) {
+			if ((buttons[i] & buttons[j] & (1 << b)) == 0)
+				continue;
+			uc->uc_rbuttons |= 1 << b;
+			uc->uc_loc_rbtn[b] = rc->uc_loc_btn[b];
+			uc->uc_iid_rbtn[b] = rc->uc_iid_btn[b];
+		}
+		return;
+	}
+}
+
+/*
+ * Split the report descriptor in to absolute pointer top-level
+ * collections in a single pass.  With UTOUCH_FLAG_FOLD_REL set in the
+ * plan, a relative-only pointer collection is merged in to an absolute
+ * one, see above.
+ */
+void
+utouch_hid_parse(struct utouch_plan *plan, const void *buf, uint16_t len)
+{
+	struct hid_data *hd;
+	struct hid_item hi;
+	struct utouch_coll *uc = NULL;
+	uint8_t buttons[UTOUCH_COLL_MAX], wheel[UTOUCH_COLL_MAX];
+	int depth, cdepth, contact, kind, nitems, ntlc;
+	uint8_t i, n;
+
+	hd = hid_start_parse(buf, len, 1 << hid_input);
+	if (hd == NULL)
+		return;
+
+	memset(buttons, 0, sizeof(buttons));
+	memset(wheel, 0, sizeof(wheel));
+	depth = 0;
+	cdepth = 0;
+	contact = -1;
+	kind = 0;
+	nitems = 0;
+	ntlc = -1;
+
+	while (hid_get_item(hd, &hi)) {
+		/* Same limits as in probe, match nothing past them */
+		if (++nitems > UTOUCH_PARSE_ITEMS_MAX ||
+		    hi.collevel > UTOUCH_PARSE_DEPTH_MAX) {
+			plan->up_ncolls = 0;
+			break;
+		}
+		switch (hi.kind) {
+		case hid_collection:
+			if (depth != 0) {
+				depth++;
+				if (kind == UTOUCH_TEST_TOUCH && cdepth == 0 &&
+				    hi.usage ==
+				     HID_USAGE2(HUP_DIGITIZERS, HUD_FINGER) &&
+				    uc->uc_mt_ncontacts < UTOUCH_MT_MAX) {
+					cdepth = depth;
+					contact = uc->uc_mt_ncontacts++;
+				}
+				break;
+			}
+			if (hi.collevel == 1)
+				ntlc++;
+			if (hi.collevel != 1 || hi.collection != 1 ||
+			    plan->up_ncolls >= UTOUCH_COLL_MAX)
+				break;
+			if (hi.usage ==
+			    HID_USAGE2(HUP_GENERIC_DESKTOP, HUG_MOUSE))
+				kind = UTOUCH_TEST_MOUSE;
+			else if (hi.usage ==
+			    HID_USAGE2(HUP_DIGITIZERS, HUD_TOUCHSCREEN))
+				kind = UTOUCH_TEST_TOUCH;
+			else
+				break;
+			uc = &plan->up_colls[plan->up_ncolls++];
+			uc->uc_tlc = ntlc;
+			depth++;
+			break;
+		case hid_endcollection:
+			if (depth == 0)
+				break;
+			if (depth == cdepth) {
+				cdepth = 0;
+				contact = -1;
+			}
+			depth--;
+			break;
+		case hid_input:
+			if (depth == 0)
+				break;
+			if (hi.report_ID != 0)
+				plan->up_flags |= UTOUCH_FLAG_HAS_ID;
+			if (kind == UTOUCH_TEST_TOUCH)
+				utouch_hid_parse_mt(uc, &hi, contact);
+			else
+				utouch_hid_parse_mouse(uc, &hi,
+				    &buttons[plan->up_ncolls - 1],
+				    &wheel[plan->up_ncolls - 1]);
+			break;
+		default:
+			break;
+		}
+	}
+	hid_end_parse(hd);
+
+	if (plan->up_flags & UTOUCH_FLAG_FOLD_REL)
+		utouch_hid_parse_fold(plan, buttons);
+
+	/* Drop the collections which turned out to be of no use */
+	for (i = 0, n = 0; i < plan->up_ncolls; i++) {
+		if (!utouch_hid_parse_finish(&plan->up_colls[i], buttons[i]))
+			continue;
+		if (n != i)
+			plan->up_colls[n] = plan->up_colls[i];
+		n++;
+	}
+	plan->up_ncolls = n;
+}
+
+static void
+utouch_field_compile(struct utouch_plan *plan, struct utouch_field *uf,
+    const struct hid_location *loc, uint8_t id)
+{
+	uint32_t off, size;
+
+	uf->uf_id = id;
+
+	/* Mirror the range limiting done by hid_get_data() */
+	size = MIN(loc->size, 32);
+	off = loc->pos / 8;
+	if (size == 0 || off >= UTOUCH_REPORT_MAX) {
+		/* Nothing or only bytes past any report, always zero */
+		return;
+	}
+	uf->uf_off = off;
+	uf->uf_shift = loc->pos % 8;
+	uf->uf_ext = 32 - size;
+	uf->uf_mask = size > 24 ? 0xffffffff :
+	    (1U << (8 * howmany(size, 8))) - 1;
+
+	off += sizeof(uint32_t);
+	if (plan->up_flags & UTOUCH_FLAG_HAS_ID)
+		off++;
+	if (off > plan->up_rdlen)
+		plan->up_rdlen = off;
+}
+
+static void
+utouch_plan_add_field(struct utouch_plan *plan, struct utouch_coll *uc,
+    uint16_t type, uint16_t code, const struct hid_location *loc, uint8_t id)
+{
+	struct utouch_field *uf;
+
+	KASSERT(uc->uc_nfields < UTOUCH_FIELD_MAX,
+	    ("utouch: too many fields"));
+	uf = &uc->uc_fields[uc->uc_nfields];
+	uc->uc_field_loc[uc->uc_nfields] = *loc;
+	uc->uc_nfields++;
+
+	uf->uf_type = type;
+	uf->uf_code = code;
+	utouch_field_compile(plan, uf, loc, id);
+}
+
+/*
+ * Turn the parsed hid_locations of a collection into a flat table of
+ * compiled fields in the order the events are to be pushed.
+ */
+static void
+utouch_coll_compile(struct utouch_plan *plan, struct utouch_coll *uc)
+{
+	struct utouch_field *uf;
+	uint8_t i, u;
+
+	if (uc->uc_flags & UTOUCH_FLAG_X_AXIS)
+		utouch_plan_add_field(plan, uc, EV_ABS, ABS_X, &uc->uc_loc_x,
+		    uc->uc_iid_x);
+	if (uc->uc_flags & UTOUCH_FLAG_Y_AXIS)
+		utouch_plan_add_field(plan, uc, EV_ABS, ABS_Y, &uc->uc_loc_y,
+		    uc->uc_iid_y);
+	if (uc->uc_flags & UTOUCH_FLAG_REL_X)
+		utouch_plan_add_field(plan, uc, EV_REL, REL_X, &uc->uc_loc_rx,
+		    uc->uc_iid_rx);
+	if (uc->uc_flags & UTOUCH_FLAG_REL_Y)
+		utouch_plan_add_field(plan, uc, EV_REL, REL_Y, &uc->uc_loc_ry,
+		    uc->uc_iid_ry);
+	if (uc->uc_flags & UTOUCH_FLAG_Z_AXIS)
+		utouch_plan_add_field(plan, uc, EV_REL, REL_WHEEL,
+		    &uc->uc_loc_z, uc->uc_iid_z);
+	if (uc->uc_flags & UTOUCH_FLAG_REL_Z)
+		utouch_plan_add_field(plan, uc, EV_REL, REL_WHEEL,
+		    &uc->uc_loc_rz, uc->uc_iid_rz);
+	for (i = 0; i < uc->uc_nbuttons; i++)
+		utouch_plan_add_field(plan, uc, EV_KEY, BTN_MOUSE + i,
+		    &uc->uc_loc_btn[i], uc->uc_iid_btn[i]);
+	for (i = 0; i < uc->uc_nbuttons; i++)
+		if (uc->uc_rbuttons & (1 << i))
+			utouch_plan_add_field(plan, uc, EV_KEY, BTN_MOUSE + i,
+			    &uc->uc_loc_rbtn[i], uc->uc_iid_rbtn[i]);
+
+	if ((uc->uc_flags & UTOUCH_FLAG_MT) == 0)
+		return;
+	if (uc->uc_flags & UTOUCH_FLAG_MT_COUNT) {
+		utouch_field_compile(plan, &uc->uc_mt_count,
+		    &uc->uc_mt_loc_count, uc->uc_iid_mt);
+		uc->uc_mt_count.uf_flags = UTOUCH_FIELD_UNSIGNED;
+	}
+	for (i = 0; i < uc->uc_mt_ncontacts; i++) {
+		for (u = 0; u < UTOUCH_MT_NUSAGES; u++) {
+			uf = &uc->uc_mt_fields[i][u];
+			utouch_field_compile(plan, uf, &uc->uc_mt_loc[i][u],
+			    uc->uc_iid_mt);
+			/* Only coordinates can have a negative range */
+			if ((u != UTOUCH_MT_X || uc->uc_ai_mt_x.min >= 0) &&
+			    (u != UTOUCH_MT_Y || uc->uc_ai_mt_y.min >= 0))
+				uf->uf_flags = UTOUCH_FIELD_UNSIGNED;
+		}
+	}
+}
+
+/*
+ * Build the compiled fields of every collection and the report ID routing
+ * table of a parsed plan.
+ */
+void
+utouch_plan_compile(struct utouch_plan *plan)
+{
+	struct utouch_coll *uc;
+	struct utouch_field *uf;
+	uint8_t i;
+
+	for (i = 0; i < plan->up_ncolls; i++) {
+		uc = &plan->up_colls[i];
+		utouch_coll_compile(plan, uc);
+
+		/* Route every report ID to the collection it belongs to */
+		for (uf = uc->uc_fields; uf < uc->uc_fields + uc->uc_nfields;
+		    uf++)
+			plan->up_coll_by_id[uf->uf_id] = i + 1;
+		if (uc->uc_flags & UTOUCH_FLAG_MT)
+			plan->up_coll_by_id[uc->uc_iid_mt] = i + 1;
+	}
+}
+
+static const char *utouch_mt_usage_names[UTOUCH_MT_NUSAGES] = {
+	[UTOUCH_MT_TIP] = "tip",
+	[UTOUCH_MT_ID] = "id",
+	[UTOUCH_MT_X] = "x",
+	[UTOUCH_MT_Y] = "y",
+};
+
+/*
+ * One line per decoded field: collection, top-level collection index,
+ * what the field is reported as, report ID and the bit position and size
+ * in the report.
+ */
+void
+utouch_plan_layout(const struct utouch_plan *plan, struct sbuf *sb)
+{
+	const struct utouch_coll *uc;
+	const struct utouch_field *uf;
+	const struct hid_location *loc;
+	u_int i, j, u;
+
+	sbuf_printf(sb, "\nplan %08x desc_bytes %u read_bytes %u parse_us %ju",
+	    plan->up_hash, plan->up_dlen, plan->up_rdlen,
+	    (uintmax_t)sbttous(plan->up_parse_time));
+	sbuf_printf(sb, "\ncoll tlc field id pos size");
+	for (i = 0; i < plan->up_ncolls; i++) {
+		uc = &plan->up_colls[i];
+		for (j = 0; j < uc->uc_nfields; j++) {
+			uf = &uc->uc_fields[j];
+			loc = &uc->uc_field_loc[j];
+			sbuf_printf(sb, "\n%u %u %s:%#x %u %u %u", i, uc->uc_tlc,
+			    uf->uf_type == EV_ABS ? "abs" :
+			    uf->uf_type == EV_REL ? "rel" : "key",
+			    uf->uf_code, uf->uf_id, loc->pos, loc->size);
+		}
+		if (uc->uc_flags & UTOUCH_FLAG_MT_COUNT)
+			sbuf_printf(sb, "\n%u %u count %u %u %u", i, uc->uc_tlc,
+			    uc->uc_iid_mt, uc->uc_mt_loc_count.pos,
+			    uc->uc_mt_loc_count.size);
+		if ((uc->uc_flags & UTOUCH_FLAG_MT) == 0)
+			continue;
+		for (j = 0; j < uc->uc_mt_ncontacts; j++) {
+			for (u = 0; u < UTOUCH_MT_NUSAGES; u++) {
+				if ((uc->uc_mt_usages[j] & (1 << u)) == 0)
+					continue;
+				loc = &uc->uc_mt_loc[j][u];
+				sbuf_printf(sb, "\n%u %u contact%u:%s %u %u %u",
+				    i, uc->uc_tlc, j, utouch_mt_usage_names[u],
+				    uc->uc_iid_mt, loc->pos, loc->size);
+			}
+		}
+	}
+}
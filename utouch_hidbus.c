@@ -0,0 +1,244 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * hidbus(4) transport for FreeBSD 13+.  hidbus creates a child device per
+ * top-level collection of the report descriptor, so every instance decodes
+ * only the collection it was attached to and receives the reports of the
+ * whole device through the hidbus interrupt handler.
+ */
+
+#include <sys/param.h>
+#include <sys/bus.h>
+#include <sys/conf.h>
+#include <sys/endian.h>
+#include <sys/kernel.h>
+#include <sys/lock.h>
+#include <sys/malloc.h>
+#include <sys/module.h>
+#include <sys/mutex.h>
+#include <sys/selinfo.h>
+#include <sys/sysctl.h>
+#include <sys/systm.h>
+#include <sys/taskqueue.h>
+#include <sys/time.h>
+
+#include <vm/vm.h>
+
+#if __FreeBSD_version >= 1300134
+
+#include <dev/hid/hid.h>
+#include <dev/hid/hidbus.h>
+
+#include <dev/evdev/input.h>
+#include <dev/evdev/evdev.h>
+
+#include "utouch.h"
+
+struct utouch_hid_softc
+{
+	struct utouch_softc hsc_core;	/* must be first */
+	struct task hsc_intr_task;
+	bool	hsc_running;	/* hid_intr_start() reference held */
+	bool	hsc_detaching;
+};
+
+static device_probe_t utouch_hid_probe;
+static device_attach_t utouch_hid_attach;
+static device_detach_t utouch_hid_detach;
+
+static hid_intr_t utouch_hid_intr;
+static task_fn_t utouch_hid_intr_task;
+static void utouch_hid_start(struct utouch_softc *);
+
+static const struct hid_device_id utouch_hid_devs[] = {
+	{ HID_TLC(HUP_GENERIC_DESKTOP, HUG_MOUSE) },
+	{ HID_TLC(HUP_DIGITIZERS, HUD_TOUCHSCREEN) },
+};
+
+static int
+utouch_hid_probe(device_t dev)
+{
+	void *d_ptr;
+	hid_size_t d_len;
+	int err;
+
+	err = HIDBUS_LOOKUP_DRIVER_INFO(dev, utouch_hid_devs);
+	if (err != 0)
+		return (err);
+
+	/* The descriptor is owned and cached by hidbus */
+	err = hid_get_report_descr(dev, &d_ptr, &d_len);
+	if (err != 0)
+		return (ENXIO);
+
+	/*
+	 * hms(4) and hmt(4) are the native drivers for these on hidbus,
+	 * only step in when they are not loaded.
+	 */
+	if (utouch_hid_test(d_ptr, d_len, hidbus_get_index(dev)) != 0)
+		return (BUS_PROBE_GENERIC);
+	return (ENXIO);
+}
+
+static int
+utouch_hid_attach(device_t dev)
+{
+	struct utouch_hid_softc *hsc = device_get_softc(dev);
+	struct utouch_softc *sc = &hsc->hsc_core;
+	const struct hid_device_info *hw = hid_get_device_info(dev);
+	void *d_ptr;
+	hid_size_t d_len;
+	int err;
+
+	device_set_desc(dev, hw->name);
+
+	sc->sc_dev = dev;
+	sc->sc_lock = hidbus_get_lock(dev);
+	sc->sc_bus = hw->idBus;
+	sc->sc_vendor = hw->idVendor;
+	sc->sc_product = hw->idProduct;
+	sc->sc_version = hw->idVersion;
+	sc->sc_serial = hw->serial;
+	sc->sc_start = utouch_hid_start;
+	sc->sc_stop = utouch_hid_start;
+	TASK_INIT(&hsc->hsc_intr_task, 0, utouch_hid_intr_task, hsc);
+
+	err = hid_get_report_descr(dev, &d_ptr, &d_len);
+	if (err != 0)
+		return (ENXIO);
+
+	if (utouch_core_init(sc) != 0 ||
+	    utouch_core_attach(sc, d_ptr, d_len, hidbus_get_index(dev)) != 0) {
+		utouch_core_detach(sc);
+		utouch_core_free(sc);
+		return (ENXIO);
+	}
+
+	/* Reports are only read while someone has the device open */
+	hidbus_set_intr(dev, utouch_hid_intr, sc);
+
+	return (0);
+}
+
+static int
+utouch_hid_detach(device_t dev)
+{
+	struct utouch_hid_softc *hsc = device_get_softc(dev);
+	struct utouch_softc *sc = &hsc->hsc_core;
+
+	mtx_lock(sc->sc_lock);
+	hsc->hsc_detaching = true;
+	mtx_unlock(sc->sc_lock);
+	taskqueue_drain(taskqueue_thread, &hsc->hsc_intr_task);
+	if (hsc->hsc_running)
+		hid_intr_stop(dev);
+	hsc->hsc_running = false;
+
+	utouch_core_detach(sc);
+	taskqueue_drain(taskqueue_thread, &hsc->hsc_intr_task);
+	utouch_core_free(sc);
+	return (0);
+}
+
+/*
+ * hidbus counts hid_intr_start() and hid_intr_stop() calls per child and
+ * polls the device while any child needs it, as for hms(4).  They sleep,
+ * so the first open and the last close, which come with the lock held,
+ * leave them to a task which makes the interrupt state follow the readers.
+ */
+static void
+utouch_hid_start(struct utouch_softc *sc)
+{
+	struct utouch_hid_softc *hsc = (struct utouch_hid_softc *)sc;
+
+	mtx_assert(sc->sc_lock, MA_OWNED);
+	taskqueue_enqueue(taskqueue_thread, &hsc->hsc_intr_task);
+}
+
+static void
+utouch_hid_intr_task(void *arg, int pending)
+{
+	struct utouch_hid_softc *hsc = arg;
+	struct utouch_softc *sc = &hsc->hsc_core;
+	bool want;
+
+	mtx_lock(sc->sc_lock);
+	want = (sc->sc_flags & UTOUCH_FLAG_READERS) != 0 &&
+	    !hsc->hsc_detaching;
+	mtx_unlock(sc->sc_lock);
+
+	if (want && !hsc->hsc_running)
+		hsc->hsc_running = hid_intr_start(sc->sc_dev) == 0;
+	else if (!want && hsc->hsc_running) {
+		hid_intr_stop(sc->sc_dev);
+		hsc->hsc_running = false;
+	}
+}
+
+/* Called by hidbus with the lock returned by hidbus_get_lock() held */
+static void
+utouch_hid_intr(void *context, void *data, hid_size_t len)
+{
+	struct utouch_softc *sc = context;
+
+	if (len > UTOUCH_REPORT_MAX)
+		len = UTOUCH_REPORT_MAX;
+	if (len == 0)
+		return;
+
+	memcpy(sc->sc_temp, data, len);
+	utouch_core_input(sc, len, sbinuptime());
+}
+
+static device_method_t utouch_hid_methods[] = {
+	DEVMETHOD(device_probe, utouch_hid_probe),
+	DEVMETHOD(device_attach, utouch_hid_attach),
+	DEVMETHOD(device_detach, utouch_hid_detach),
+
+	DEVMETHOD_END
+};
+
+static driver_t utouch_hid_driver = {
+	.name = "utouch",
+	.methods = utouch_hid_methods,
+	.size = sizeof(struct utouch_hid_softc),
+};
+
+#if __FreeBSD_version >= 1400058
+DRIVER_MODULE(utouch, hidbus, utouch_hid_driver, utouch_modevent, NULL);
+#else
+static devclass_t utouch_hid_devclass;
+
+DRIVER_MODULE(utouch, hidbus, utouch_hid_driver, utouch_hid_devclass,
+    utouch_modevent, NULL);
+#endif
+MODULE_DEPEND(utouch, hidbus, 1, 1, 1);
+HID_PNP_INFO(utouch_hid_devs);
+
+#endif /* __FreeBSD_version >= 1300134 */
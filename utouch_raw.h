@@ -0,0 +1,72 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+#ifndef _UTOUCH_RAW_H_
+#define	_UTOUCH_RAW_H_
+
+/*
+ * Layout of the raw report ring exported read-only through mmap(2) of
+ * /dev/utouchN.raw.
+ *
+ * The driver appends every interrupt report it receives as a record and
+ * then advances urh_head.  Record number "seq" lives in slot
+ * seq & (urh_nrecords - 1) and has urr_seq set to seq once it is complete.
+ * A consumer remembers the last sequence number it has seen, copies the
+ * records up to urh_head and treats a record as lost if its urr_seq does
+ * not match, before and after the copy, or if urh_head has advanced more
+ * than urh_nrecords past it.
+ *
+ * read(2) of 8 bytes waits until at least dev.utouch.N.raw_batch new
+ * records have been produced since the previous read(2) on the same file
+ * descriptor, and returns the current urh_head.  poll(2) and kqueue(2)
+ * report the descriptor readable under the same condition.
+ */
+
+#define	UTOUCH_RAW_MAGIC	0x75747277	/* "utrw" */
+#define	UTOUCH_RAW_VERSION	1
+#define	UTOUCH_RAW_REPORT_MAX	64
+
+struct utouch_raw_header {
+	uint32_t	urh_magic;
+	uint32_t	urh_version;
+	uint32_t	urh_nrecords;	/* number of slots, a power of 2 */
+	uint32_t	urh_recsize;	/* sizeof(struct utouch_raw_record) */
+	uint32_t	urh_offset;	/* offset of slot 0 from the header */
+	uint32_t	urh_pad;
+	volatile uint64_t urh_head;	/* number of records produced */
+};
+
+struct utouch_raw_record {
+	uint64_t	urr_time;	/* completion time, ns of uptime */
+	volatile uint64_t urr_seq;	/* record sequence number */
+	uint16_t	urr_len;	/* report length, with report ID */
+	uint8_t		urr_pad[6];
+	uint8_t		urr_data[UTOUCH_RAW_REPORT_MAX];
+};
+
+#endif /* !_UTOUCH_RAW_H_ */
@@ -0,0 +1,255 @@
+/*-
+ * Copyright (c) 2018, Vladimir Kondratyev <wulf@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * $FreeBSD$
+ */
+
+/*
+ * utouchstat - print utouch(4) counters per unit and interval.
+ *
+ * usage: utouchstat [--libxo ...] [-c count] [-w wait] [unit ...]
+ */
+
+#include <sys/types.h>
+#include <sys/sysctl.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libxo/xo.h>
+
+#define	UTOUCHSTAT_UNITS_MAX	64
+#define	UTOUCHSTAT_LAT_BUCKETS	16	/* UTOUCH_LAT_BUCKETS of the driver */
+
+struct ustat
+{
+	bool	 valid;
+	uint64_t reports;
+	uint64_t ignored;
+	uint64_t events;
+	uint64_t syncs;
+	uint64_t unchanged;
+	uint64_t filtered;
+	uint64_t stale;
+	uint64_t errors;	/* USB attachment only */
+	uint64_t lat[UTOUCHSTAT_LAT_BUCKETS];
+};
+
+static struct ustat prev[UTOUCHSTAT_UNITS_MAX];
+static struct ustat cur[UTOUCHSTAT_UNITS_MAX];
+
+static void
+usage(void)
+{
+
+	xo_error("usage: utouchstat [--libxo ...] [-c count] [-w wait] "
+	    "[unit ...]\n");
+	xo_finish();
+	exit(1);
+}
+
+static int
+get_u64(int unit, const char *name, uint64_t *val)
+{
+	char oid[64];
+	size_t len;
+
+	snprintf(oid, sizeof(oid), "dev.utouch.%d.%s", unit, name);
+	len = sizeof(*val);
+	*val = 0;
+	return (sysctlbyname(oid, val, &len, NULL, 0));
+}
+
+static void
+fetch(int unit, struct ustat *us)
+{
+	char oid[64];
+	size_t len;
+
+	memset(us, 0, sizeof(*us));
+	if (get_u64(unit, "reports", &us->reports) != 0)
+		return;
+	get_u64(unit, "ignored", &us->ignored);
+	get_u64(unit, "events", &us->events);
+	get_u64(unit, "syncs", &us->syncs);
+	get_u64(unit, "unchanged", &us->unchanged);
+	get_u64(unit, "filtered", &us->filtered);
+	get_u64(unit, "stale_dropped", &us->stale);
+	get_u64(unit, "errors", &us->errors);
+
+	snprintf(oid, sizeof(oid), "dev.utouch.%d.latency_hist", unit);
+	len = sizeof(us->lat);
+	if (sysctlbyname(oid, us->lat, &len, NULL, 0) != 0)
+		memset(us->lat, 0, sizeof(us->lat));
+	us->valid = true;
+}
+
+/*
+ * Upper bound, in microseconds, of the latency bucket holding the pct-th
+ * percentile of the interval, -1 if there were no samples.
+ */
+static int64_t
+percentile(const uint64_t *hist, uint64_t total, u_int pct)
+{
+	uint64_t need, sum;
+	int b;
+
+	if (total == 0)
+		return (-1);
+	need = (total * pct + 99) / 100;
+	sum = 0;
+	for (b = 0; b < UTOUCHSTAT_LAT_BUCKETS - 1; b++) {
+		sum += hist[b];
+		if (sum >= need)
+			break;
+	}
+	return (b == 0 ? 0 : ((int64_t)1 << b) - 1);
+}
+
+static void
+show(int unit, const struct ustat *p, const struct ustat *c, double secs)
+{
+	uint64_t hist[UTOUCHSTAT_LAT_BUCKETS], total;
+	int b;
+
+	total = 0;
+	for (b = 0; b < UTOUCHSTAT_LAT_BUCKETS; b++) {
+		hist[b] = c->lat[b] - p->lat[b];
+		total += hist[b];
+	}
+
+	xo_open_instance("device");
+	xo_emit("{k:unit/%5d} ", unit);
+	xo_emit("{:reports/%8.0f} {:events/%8.0f} {:syncs/%8.0f} ",
+	    (c->reports - p->reports) / secs,
+	    (c->events - p->events) / secs,
+	    (c->syncs - p->syncs) / secs);
+	xo_emit("{:unchanged/%8.0f} {:ignored/%8.0f} {:filtered/%8.0f} "
+	    "{:stale/%6.0f} {:errors/%6.0f} ",
+	    (c->unchanged - p->unchanged) / secs,
+	    (c->ignored - p->ignored) / secs,
+	    (c->filtered - p->filtered) / secs,
+	    (c->stale - p->stale) / secs,
+	    (c->errors - p->errors) / secs);
+	xo_emit("{:latency-p50/%6jd} {:latency-p90/%6jd} "
+	    "{:latency-p99/%6jd}\n",
+	    (intmax_t)percentile(hist, total, 50),
+	    (intmax_t)percentile(hist, total, 90),
+	    (intmax_t)percentile(hist, total, 99));
+	xo_close_instance("device");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct timespec then, now;
+	bool units[UTOUCHSTAT_UNITS_MAX], any;
+	double secs;
+	long count, wait;
+	char *ep;
+	int ch, u, iter;
+
+	argc = xo_parse_args(argc, argv);
+	if (argc < 0)
+		exit(1);
+
+	count = 0;
+	wait = 1;
+	while ((ch = getopt(argc, argv, "c:w:")) != -1) {
+		switch (ch) {
+		case 'c':
+			count = strtol(optarg, &ep, 10);
+			if (*ep != '\0' || count <= 0)
+				usage();
+			break;
+		case 'w':
+			wait = strtol(optarg, &ep, 10);
+			if (*ep != '\0' || wait <= 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	memset(units, 0, sizeof(units));
+	any = argc == 0;
+	for (; argc > 0; argc--, argv++) {
+		u = strtol(*argv, &ep, 10);
+		if (*ep != '\0' || u < 0 || u >= UTOUCHSTAT_UNITS_MAX)
+			usage();
+		units[u] = true;
+	}
+
+	for (u = 0; u < UTOUCHSTAT_UNITS_MAX; u++)
+		if (any || units[u])
+			fetch(u, &prev[u]);
+	clock_gettime(CLOCK_MONOTONIC, &then);
+
+	xo_open_container("utouchstat");
+	xo_open_list("interval");
+	for (iter = 0; count == 0 || iter < count; iter++) {
+		sleep(wait);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		secs = (now.tv_sec - then.tv_sec) +
+		    (now.tv_nsec - then.tv_nsec) / 1e9;
+		then = now;
+
+		xo_open_instance("interval");
+		/* Rates are per second, latencies in microseconds */
+		xo_emit("{T:unit/%5s} {T:reports/%8s} {T:events/%8s} "
+		    "{T:syncs/%8s} {T:unchngd/%8s} {T:ignored/%8s} "
+		    "{T:filtered/%8s} {T:stale/%6s} "
+		    "{T:errors/%6s} {T:p50us/%6s} {T:p90us/%6s} "
+		    "{T:p99us/%6s}\n");
+		xo_open_list("device");
+		for (u = 0; u < UTOUCHSTAT_UNITS_MAX; u++) {
+			if (!any && !units[u])
+				continue;
+			fetch(u, &cur[u]);
+			/* Skip units which are gone or have just appeared */
+			if (cur[u].valid && prev[u].valid)
+				show(u, &prev[u], &cur[u], secs);
+			prev[u] = cur[u];
+		}
+		xo_close_list("device");
+		xo_close_instance("interval");
+		xo_flush();
+	}
+	xo_close_list("interval");
+	xo_close_container("utouchstat");
+	xo_finish();
+
+	return (0);
+}